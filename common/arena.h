@@ -0,0 +1,86 @@
+#ifndef TOZ3_COMMON_ARENA_H_
+#define TOZ3_COMMON_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>   // std::unique_ptr
+#include <new>      // placement new
+#include <utility>  // std::forward
+#include <vector>   // std::vector
+
+#include "type_base.h"
+
+namespace TOZ3 {
+
+// Backs the instances of a single interpretation. Instances are carved out of
+// large blocks and are all destroyed together when the arena is cleared, so
+// the memory of an interpretation does not outlive it.
+class InstanceArena {
+ private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    // Blocks past the current one are empty and reused after a clear.
+    size_t block_idx = 0;
+    size_t block_offset = BLOCK_SIZE;
+    // Instances which exceed a block get their own allocation.
+    std::vector<std::unique_ptr<char[]>> large_allocs;
+    // All live instances in allocation order, used to run their destructors.
+    std::vector<P4Z3Instance *> instances;
+
+    void *reserve(size_t size, size_t align) {
+        if (size > BLOCK_SIZE / 4) {
+            large_allocs.emplace_back(new char[size + align]);
+            auto addr = reinterpret_cast<uintptr_t>(large_allocs.back().get());
+            return reinterpret_cast<void *>((addr + align - 1) & ~(align - 1));
+        }
+        size_t offset = (block_offset + align - 1) & ~(align - 1);
+        if (offset + size > BLOCK_SIZE) {
+            if (!blocks.empty()) {
+                block_idx++;
+            }
+            if (block_idx == blocks.size()) {
+                blocks.emplace_back(new char[BLOCK_SIZE]);
+            }
+            offset = 0;
+        }
+        block_offset = offset + size;
+        return blocks[block_idx].get() + offset;
+    }
+
+ public:
+    InstanceArena() = default;
+    ~InstanceArena() { clear(); }
+    InstanceArena(const InstanceArena &) = delete;
+    InstanceArena &operator=(const InstanceArena &) = delete;
+
+    template <typename T, typename... Args> T *allocate(Args &&...args) {
+        // Blocks are allocated with new[], which aligns for any basic type.
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "Over-aligned instances are not supported.");
+        void *mem = reserve(sizeof(T), alignof(T));
+        auto *instance = new (mem) T(std::forward<Args>(args)...);
+        instances.push_back(instance);
+        return instance;
+    }
+
+    // Destroys all instances. The blocks are kept for the next interpretation.
+    void clear() {
+        for (auto it = instances.rbegin(); it != instances.rend(); ++it) {
+            (*it)->~P4Z3Instance();
+        }
+        instances.clear();
+        large_allocs.clear();
+        block_idx = 0;
+        block_offset = blocks.empty() ? BLOCK_SIZE : 0;
+    }
+
+    size_t get_num_instances() const { return instances.size(); }
+    // Bytes reserved by the blocks, which are kept across clears.
+    size_t get_num_bytes() const { return blocks.size() * BLOCK_SIZE; }
+};
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_COMMON_ARENA_H_
@@ -15,14 +15,15 @@ bool Z3Visitor::preorder(const IR::Constant *c) {
     if (const auto *tb = c->type->to<IR::Type_Bits>()) {
         auto val_string = Util::toString(c->value, 0, false);
         auto expr = state->get_z3_ctx()->bv_val(val_string, tb->size);
-        auto *wrapper = new Z3Bitvector(state, tb, expr, tb->isSigned);
+        auto *wrapper = state->allocate<Z3Bitvector>(state, tb, expr,
+                                                     tb->isSigned);
         state->set_expr_result(wrapper);
         return false;
     }
     if (c->type->is<IR::Type_InfInt>()) {
         auto val_string = Util::toString(c->value, 0, false);
         auto expr = state->get_z3_ctx()->int_val(val_string);
-        auto *var = new Z3Int(state, expr);
+        auto *var = state->allocate<Z3Int>(state, expr);
         state->set_expr_result(var);
         return false;
     }
@@ -32,14 +33,14 @@ bool Z3Visitor::preorder(const IR::Constant *c) {
 
 bool Z3Visitor::preorder(const IR::BoolLiteral *bl) {
     auto expr = state->get_z3_ctx()->bool_val(bl->value);
-    auto *wrapper = new Z3Bitvector(state, &BOOL_TYPE, expr);
+    auto *wrapper = state->allocate<Z3Bitvector>(state, &BOOL_TYPE, expr);
     state->set_expr_result(wrapper);
     return false;
 }
 
 bool Z3Visitor::preorder(const IR::StringLiteral *sl) {
     auto expr = state->get_z3_ctx()->string_val(sl->value);
-    auto *wrapper = new Z3Bitvector(state, &STRING_TYPE, expr);
+    auto *wrapper = state->allocate<Z3Bitvector>(state, &STRING_TYPE, expr);
     state->set_expr_result(wrapper);
     return false;
 }
@@ -56,7 +57,8 @@ bool Z3Visitor::preorder(const IR::ListExpression *le) {
         visit(component);
         members.push_back(state->copy_expr_result());
     }
-    state->set_expr_result(new ListInstance(state, members, le->type));
+    state->set_expr_result(
+        state->allocate<ListInstance>(state, members, le->type));
     return false;
 }
 
@@ -76,7 +78,8 @@ bool Z3Visitor::preorder(const IR::StructExpression *se) {
         }
         state->set_expr_result(instance);
     } else {
-        state->set_expr_result(new ListInstance(state, members, se->type));
+        state->set_expr_result(
+            state->allocate<ListInstance>(state, members, se->type));
     }
     return false;
 }
@@ -130,7 +133,7 @@ void resolve_stack_call(Visitor *visitor, P4State *state,
 
     // Execute and merge the functions
     if (const auto *name = boost::get<cstring>(&member_struct.target_member)) {
-        std::vector<std::pair<z3::expr, VarMap>> call_vars;
+        std::vector<std::pair<z3::expr, VarSnapshot>> call_vars;
         for (auto &parent_pair : hdr_pairs) {
             auto cond = parent_pair.first;
             auto *parent_class = parent_pair.second;
@@ -162,6 +165,13 @@ FunOrMethod resolve_var_or_decl_parent(P4State *state,
     } else {
         // try to find the result in vars and fail otherwise
         parent_class = state->get_var(member_struct.main_member);
+        // Header methods may modify the variable in place, so they must not
+        // operate on an instance that is shared with a saved state.
+        const auto *target = boost::get<cstring>(&member_struct.target_member);
+        if (parent_class->is<StructBase>() &&
+            (target == nullptr || *target != "isValid")) {
+            parent_class = state->get_mut_var(member_struct.main_member);
+        }
     }
 
     for (auto it = member_struct.mid_members.rbegin();
@@ -222,7 +232,7 @@ P4Z3Instance *exec_function(Z3Visitor *visitor, const IR::Function *f) {
         return merged_return;
     }
     // If there are no return expressions, return a void result
-    return new VoidResult();
+    return state->allocate<VoidResult>(state);
 }
 
 P4Z3Instance *exec_method(Z3Visitor *visitor, const IR::Method *m) {
@@ -258,8 +268,9 @@ P4Z3Instance *exec_method(Z3Visitor *visitor, const IR::Method *m) {
 }
 
 P4Z3Instance *exec_action(Z3Visitor *visitor, const IR::P4Action *a) {
+    auto *state = visitor->get_state();
     visitor->visit(a->body);
-    return new VoidResult();
+    return state->allocate<VoidResult>(state);
 }
 
 bool Z3Visitor::preorder(const IR::MethodCallExpression *mce) {
@@ -359,7 +370,7 @@ bool Z3Visitor::preorder(const IR::ConstructorCallExpression *cce) {
     auto var_map =
         state->merge_args_with_params(this, *arguments, *params, *type_params);
     state->set_expr_result(
-        new ControlInstance(state, resolved_type, var_map.second));
+        state->allocate<ControlInstance>(state, resolved_type, var_map.second));
     return false;
 }
 }  // namespace TOZ3
@@ -0,0 +1,144 @@
+#ifndef TOZ3_COMMON_NAME_MAP_H_
+#define TOZ3_COMMON_NAME_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>  // std::pair
+#include <vector>   // std::vector
+
+#include "lib/cstring.h"
+#include "lib/exceptions.h"
+
+namespace TOZ3 {
+
+// Maps names to values and iterates in insertion order. P4C interns every
+// cstring, so the address of its characters already serves as a symbol id and
+// a lookup compares pointers instead of strings. Small maps are searched
+// linearly, larger ones through an open-addressing index into the entries.
+template <typename V> class NameMap {
+ public:
+    using key_type = cstring;
+    using mapped_type = V;
+    using value_type = std::pair<cstring, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+ private:
+    // Most scopes only hold a handful of names.
+    static constexpr size_t LINEAR_LIMIT = 8;
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    std::vector<value_type> entries;
+    // Positions of the entries, empty while the map is searched linearly.
+    std::vector<uint32_t> slots;
+
+    static size_t hash_name(cstring name) {
+        auto addr = reinterpret_cast<uintptr_t>(name.c_str());
+        // Fibonacci hashing, the low bits of an address carry little entropy.
+        return static_cast<size_t>((addr * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    size_t find_idx(cstring name) const {
+        if (slots.empty()) {
+            for (size_t idx = 0; idx < entries.size(); ++idx) {
+                if (entries[idx].first.c_str() == name.c_str()) {
+                    return idx;
+                }
+            }
+            return entries.size();
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t pos = hash_name(name) & mask;; pos = (pos + 1) & mask) {
+            auto slot = slots[pos];
+            if (slot == EMPTY_SLOT) {
+                return entries.size();
+            }
+            if (entries[slot].first.c_str() == name.c_str()) {
+                return slot;
+            }
+        }
+    }
+
+    void index_entry(size_t idx) {
+        size_t mask = slots.size() - 1;
+        size_t pos = hash_name(entries[idx].first) & mask;
+        while (slots[pos] != EMPTY_SLOT) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = idx;
+    }
+
+    iterator append(cstring name, V value) {
+        entries.emplace_back(name, std::move(value));
+        if (entries.size() > LINEAR_LIMIT &&
+            entries.size() * 2 > slots.size()) {
+            // Keep the load factor of the index at most one half.
+            size_t capacity = 16;
+            while (capacity < entries.size() * 2) {
+                capacity *= 2;
+            }
+            slots.assign(capacity, static_cast<uint32_t>(EMPTY_SLOT));
+            for (size_t idx = 0; idx < entries.size(); ++idx) {
+                index_entry(idx);
+            }
+        } else if (!slots.empty()) {
+            index_entry(entries.size() - 1);
+        }
+        return entries.end() - 1;
+    }
+
+ public:
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    const_iterator find(cstring name) const {
+        return entries.begin() + find_idx(name);
+    }
+    iterator find(cstring name) { return entries.begin() + find_idx(name); }
+    size_t count(cstring name) const {
+        return find_idx(name) < entries.size() ? 1 : 0;
+    }
+    const V &at(cstring name) const {
+        auto idx = find_idx(name);
+        if (idx == entries.size()) {
+            BUG("Key %s not found in name map.", name);
+        }
+        return entries[idx].second;
+    }
+    V &at(cstring name) {
+        return const_cast<V &>(static_cast<const NameMap *>(this)->at(name));
+    }
+    V &operator[](cstring name) {
+        auto idx = find_idx(name);
+        if (idx == entries.size()) {
+            return append(name, V())->second;
+        }
+        return entries[idx].second;
+    }
+    // Like std::map, an existing entry is not overwritten.
+    std::pair<iterator, bool> insert(const value_type &value) {
+        auto idx = find_idx(value.first);
+        if (idx < entries.size()) {
+            return {entries.begin() + idx, false};
+        }
+        return {append(value.first, value.second), true};
+    }
+    template <typename InputIt> void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+    void clear() {
+        entries.clear();
+        slots.clear();
+    }
+};
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_COMMON_NAME_MAP_H_
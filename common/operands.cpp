@@ -158,7 +158,8 @@ bool Z3Visitor::preorder(const IR::Equ *expr) {
     const auto *right = state->get_expr_result();
 
     auto &&result = *left == *right;
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, result));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, result));
 
     return false;
 }
@@ -169,7 +170,8 @@ bool Z3Visitor::preorder(const IR::Neq *expr) {
     visit(expr->right);
     const auto *right = state->get_expr_result();
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, *left != *right));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, *left != *right));
 
     return false;
 }
@@ -180,7 +182,8 @@ bool Z3Visitor::preorder(const IR::Lss *expr) {
     visit(expr->right);
     const auto *right = state->get_expr_result();
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, *left < *right));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, *left < *right));
 
     return false;
 }
@@ -191,7 +194,8 @@ bool Z3Visitor::preorder(const IR::Leq *expr) {
     visit(expr->right);
     const auto *right = state->get_expr_result();
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, *left <= *right));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, *left <= *right));
 
     return false;
 }
@@ -202,7 +206,8 @@ bool Z3Visitor::preorder(const IR::Grt *expr) {
     visit(expr->right);
     const auto *right = state->get_expr_result();
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, *left > *right));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, *left > *right));
 
     return false;
 }
@@ -213,7 +218,8 @@ bool Z3Visitor::preorder(const IR::Geq *expr) {
     visit(expr->right);
     const auto *right = state->get_expr_result();
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, *left >= *right));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, *left >= *right));
 
     return false;
 }
@@ -261,7 +267,8 @@ bool Z3Visitor::preorder(const IR::LAnd *expr) {
     auto land_expr = *left && *state->get_expr_result();
     state->merge_vars(!*left->get_val(), old_vars);
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, land_expr));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, land_expr));
 
     return false;
 }
@@ -280,7 +287,8 @@ bool Z3Visitor::preorder(const IR::LOr *expr) {
     auto lor_expr = *left || *state->get_expr_result();
     state->merge_vars(*left->get_val(), old_vars);
 
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, lor_expr));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, lor_expr));
 
     return false;
 }
@@ -337,7 +345,7 @@ bool Z3Visitor::preorder(const IR::Mux *m) {
     visit(m->e1);
     state->pop_forward_cond();
     auto then_has_exited = state->has_exited();
-    VarMap then_vars;
+    VarSnapshot then_vars;
     if (then_has_exited) {
         then_vars = old_vars;
     } else {
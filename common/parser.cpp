@@ -13,12 +13,7 @@ z3::expr handle_select_cond(Z3Visitor *visitor, const StructBase *select_list,
                             const IR::ListExpression *list_expr);
 
 std::vector<P4Z3Instance *> get_vec_from_map(const StructBase *input_struct) {
-    std::vector<P4Z3Instance *> target_list;
-    for (const auto &member : *input_struct->get_member_map()) {
-        auto *member_instance = member.second;
-        target_list.push_back(member_instance);
-    }
-    return target_list;
+    return input_struct->get_members();
 }
 
 z3::expr check_cond(Z3Visitor *visitor, const P4Z3Instance *select_eval,
@@ -27,7 +22,7 @@ z3::expr check_cond(Z3Visitor *visitor, const P4Z3Instance *select_eval,
     if (const auto *range = match_key->to<IR::Range>()) {
         // TODO: A hack to deal with mismatch between lists and ranges
         if (const auto *li = select_eval->to<ListInstance>()) {
-            select_eval = li->get_member_map()->begin()->second;
+            select_eval = li->get_members().front();
         }
         visitor->visit(range->left);
         const auto *min = state->copy_expr_result();
@@ -38,7 +33,7 @@ z3::expr check_cond(Z3Visitor *visitor, const P4Z3Instance *select_eval,
     if (const auto *mask_expr = match_key->to<IR::Mask>()) {
         // TODO: A hack to deal with mismatch between lists and masks
         if (const auto *li = select_eval->to<ListInstance>()) {
-            select_eval = li->get_member_map()->begin()->second;
+            select_eval = li->get_members().front();
         }
         visitor->visit(mask_expr->left);
         const auto *val = state->copy_expr_result();
@@ -111,7 +106,7 @@ void process_select_cases(
     auto *state = visitor->get_state();
     bool has_exited = true;
     bool has_returned = true;
-    std::vector<std::pair<z3::expr, VarMap>> case_states;
+    std::vector<std::pair<z3::expr, VarSnapshot>> case_states;
     for (const auto &select : select_vector) {
         const auto cond = select.first;
         auto path_name = select.second;
@@ -133,7 +128,7 @@ void process_select_cases(
         auto call_has_exited = state->has_exited();
         auto stmt_has_returned = state->has_returned();
         if (!(call_has_exited || stmt_has_returned)) {
-            case_states.emplace_back(cond, state->get_vars());
+            case_states.emplace_back(cond, state->clone_vars());
         }
         has_exited = has_exited && call_has_exited;
         has_returned = has_returned && stmt_has_returned;
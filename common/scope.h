@@ -1,7 +1,6 @@
 #ifndef TOZ3_COMMON_SCOPE_H_
 #define TOZ3_COMMON_SCOPE_H_
 
-#include <map>      // std::map
 #include <set>      // std::set
 #include <utility>  // std::pair
 #include <vector>   // std::vector
@@ -10,16 +9,20 @@
 
 namespace TOZ3 {
 
+// The variables of every scope on the stack, outermost first. Each map shares
+// its storage with its scope, so a snapshot only copies a pointer per scope.
+using VarSnapshot = std::vector<VarMap>;
+
 class P4Scope {
  private:
     // maps of local values and types
-    std::map<cstring, P4Declaration *> static_decls;
+    NameMap<P4Declaration *> static_decls;
     VarMap var_map;
-    std::map<cstring, const IR::Type *> type_map;
+    NameMap<const IR::Type *> type_map;
     bool is_returned = false;
 
     std::vector<std::pair<z3::expr, P4Z3Instance *>> return_exprs;
-    std::vector<std::pair<z3::expr, VarMap>> return_states;
+    std::vector<std::pair<z3::expr, VarSnapshot>> return_states;
     std::vector<z3::expr> forward_conds;
     std::vector<z3::expr> return_conds;
     CopyArgs copy_out_args;
@@ -40,7 +43,12 @@ class P4Scope {
     bool has_static_decl(cstring name) const {
         return static_decls.count(name) > 0;
     }
-    const std::map<cstring, P4Declaration *> *get_decl_map() const {
+    // Returns nullptr if the name is not declared in this scope.
+    P4Declaration *find_static_decl(cstring name) const {
+        auto it = static_decls.find(name);
+        return it != static_decls.end() ? it->second : nullptr;
+    }
+    const NameMap<P4Declaration *> *get_decl_map() const {
         return &static_decls;
     }
     /****** VARIABLES ******/
@@ -67,6 +75,12 @@ class P4Scope {
         var_map[name] = {val, decl_type};
     }
     bool has_var(cstring name) const { return var_map.count(name) > 0; }
+    // Returns the instance and type of a variable, or nullptr if the name is
+    // not declared in this scope.
+    const VarMap::mapped_type *find_var(cstring name) const {
+        auto it = var_map.find(name);
+        return it != var_map.end() ? &it->second : nullptr;
+    }
     const VarMap &get_var_map() const { return var_map; }
 
     /****** TYPES ******/
@@ -83,6 +97,11 @@ class P4Scope {
     }
 
     bool has_type(cstring name) const { return type_map.count(name) > 0; }
+    // Returns nullptr if the type is not declared in this scope.
+    const IR::Type *find_type(cstring name) const {
+        auto it = type_map.find(name);
+        return it != type_map.end() ? it->second : nullptr;
+    }
 
     const IR::Type *resolve_type(const IR::Type *type) const {
         const IR::Type *ret_type = type;
@@ -130,34 +149,15 @@ class P4Scope {
     std::vector<std::pair<z3::expr, P4Z3Instance *>> get_return_exprs() const {
         return return_exprs;
     }
-    void push_return_state(const z3::expr &cond, const VarMap &state) {
+    void push_return_state(const z3::expr &cond, const VarSnapshot &state) {
         return return_states.emplace_back(cond, state);
     }
-    std::vector<std::pair<z3::expr, VarMap>> get_return_states() const {
+    std::vector<std::pair<z3::expr, VarSnapshot>> get_return_states() const {
         return return_states;
     }
     void clear_return_states() { return_states.clear(); }
     void clear_return_exprs() { return_exprs.clear(); }
 
-    P4Scope clone() const {
-        auto new_scope = *this;
-        for (const auto &value_tuple : get_var_map()) {
-            auto var_name = value_tuple.first;
-            auto *member_cpy = value_tuple.second.first->copy();
-            new_scope.update_var(var_name, member_cpy);
-        }
-        return new_scope;
-    }
-    VarMap clone_vars() const {
-        VarMap cloned_map;
-        for (const auto &value_tuple : get_var_map()) {
-            auto var_name = value_tuple.first;
-            auto *member_cpy = value_tuple.second.first->copy();
-            const auto *member_type = value_tuple.second.second;
-            cloned_map.insert({var_name, {member_cpy, member_type}});
-        }
-        return cloned_map;
-    }
     friend inline std::ostream &operator<<(std::ostream &out,
                                            const TOZ3::P4Scope &scope) {
         auto var_map = scope.get_var_map();
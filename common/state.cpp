@@ -7,6 +7,7 @@
 #include <ostream>
 #include <string>
 #include <tuple>
+#include <utility>
 
 #include "ir/node.h"
 #include "ir/visitor.h"
@@ -128,7 +129,7 @@ get_hdr_pairs(P4State *state, const MemberStruct &member_struct) {
     std::vector<std::pair<z3::expr, P4Z3Instance *>> parent_pairs;
     auto tmp_parent_pairs = parent_pairs;
     parent_pairs.emplace_back(state->get_z3_ctx()->bool_val(true),
-                              state->get_var(member_struct.main_member));
+                              state->get_mut_var(member_struct.main_member));
     // Collect all the headers that need to be set
     for (auto it = member_struct.mid_members.rbegin();
          it != member_struct.mid_members.rend(); ++it) {
@@ -312,13 +313,22 @@ void P4State::set_var(const MemberStruct &member_struct, P4Z3Instance *rval) {
         const auto *bit_type =
             new IR::Type_Bits(target_rval.get_sort().bv_size(), false);
         auto *resolved_rval =
-            new Z3Bitvector(this, bit_type, target_rval, is_signed);
+            allocate<Z3Bitvector>(this, bit_type, target_rval, is_signed);
+        if (slice_less_member_struct.is_flat) {
+            // The new instance is not referenced anywhere else yet.
+            update_var(member_struct.main_member, resolved_rval);
+            owned_vars.insert(resolved_rval);
+            return;
+        }
         set_var(slice_less_member_struct, resolved_rval);
         return;
     }
     if (member_struct.is_flat) {
         // Flat target, just update state
-        update_var(member_struct.main_member, rval);
+        const auto *dest_type = get_var_type(member_struct.main_member);
+        auto *cast_val = rval->cast_allocate(dest_type);
+        update_var(member_struct.main_member, cast_val);
+        owned_vars.insert(cast_val);
         return;
     }
     // If we are dealing with a stack, start with a complicated procedure
@@ -328,7 +338,7 @@ void P4State::set_var(const MemberStruct &member_struct, P4Z3Instance *rval) {
         return;
     }
     // This is the default mode where we only have strings for a member.
-    auto *parent_class = get_var(member_struct.main_member);
+    auto *parent_class = get_mut_var(member_struct.main_member);
     for (auto it = member_struct.mid_members.rbegin();
          it != member_struct.mid_members.rend(); ++it) {
         auto name = boost::get<cstring>(*it);
@@ -349,6 +359,7 @@ void P4State::set_var(Visitor *visitor, const IR::Expression *target,
         const auto *dest_type = get_var_type(name->path->name.name);
         auto *cast_val = rval->cast_allocate(dest_type);
         update_var(name->path->name, cast_val);
+        owned_vars.insert(cast_val);
         return;
     }
     auto member_struct = get_member_struct(this, visitor, target);
@@ -365,6 +376,7 @@ void P4State::set_var(Visitor *visitor, const IR::Expression *target,
         const auto *tmp_rval = get_expr_result();
         auto *cast_val = tmp_rval->cast_allocate(dest_type);
         update_var(name->path->name, cast_val);
+        owned_vars.insert(cast_val);
         return;
     }
     auto member_struct = get_member_struct(this, visitor, target);
@@ -491,16 +503,20 @@ void P4State::copy_out() {
 }
 
 z3::expr P4State::gen_z3_expr(cstring name, const IR::Type *type) {
+    z3::expr var(*ctx);
     if (const auto *tbi = type->to<IR::Type_Bits>()) {
-        return ctx->bv_const(name, tbi->size);
-    }
-    if (const auto *tvb = type->to<IR::Type_Varbits>()) {
-        return ctx->bv_const(name, tvb->size);
+        var = ctx->bv_const(name, tbi->size);
+    } else if (const auto *tvb = type->to<IR::Type_Varbits>()) {
+        var = ctx->bv_const(name, tvb->size);
+    } else if (type->is<IR::Type_Boolean>()) {
+        var = ctx->bool_const(name);
+    } else {
+        BUG("Type \"%s\" not supported for Z3 expressions!.", type);
     }
-    if (type->is<IR::Type_Boolean>()) {
-        return ctx->bool_const(name);
+    if (name == UNDEF_LABEL) {
+        record_undefined(var);
     }
-    BUG("Type \"%s\" not supported for Z3 expressions!.", type);
+    return var;
 }
 
 P4Z3Instance *P4State::gen_instance(cstring name, const IR::Type *type,
@@ -509,11 +525,17 @@ P4Z3Instance *P4State::gen_instance(cstring name, const IR::Type *type,
     if (const auto *tn = type->to<IR::Type_Name>()) {
         type = resolve_type(tn);
     }
+    auto it = prototype_cache.find(type);
+    if (it != prototype_cache.end()) {
+        auto *cached = it->second->copy()->to_mut<StructBase>();
+        cached->rename(name, id);
+        return cached;
+    }
     // TODO: Split this up to not muddle things.
     if (const auto *t = type->to<IR::Type_Struct>()) {
-        instance = new StructInstance(this, t, name, id);
+        instance = allocate<StructInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_Header>()) {
-        instance = new HeaderInstance(this, t, name, id);
+        instance = allocate<HeaderInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_Enum>()) {
         // TODO: Clean this up
         // For Enums we just return a copy of the declaration
@@ -534,27 +556,110 @@ P4Z3Instance *P4State::gen_instance(cstring name, const IR::Type *type,
         enum_instance->set_enum_val(gen_z3_expr(name, resolve_type(t->type)));
         instance = enum_instance;
     } else if (const auto *t = type->to<IR::Type_Stack>()) {
-        instance = new StackInstance(this, t, name, id);
+        instance = allocate<StackInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_HeaderUnion>()) {
-        instance = new HeaderUnionInstance(this, t, name, id);
+        instance = allocate<HeaderUnionInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_List>()) {
-        instance = new ListInstance(this, t, name, id);
+        instance = allocate<ListInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_Tuple>()) {
-        instance = new TupleInstance(this, t, name, id);
+        instance = allocate<TupleInstance>(this, t, name, id);
     } else if (const auto *t = type->to<IR::Type_Extern>()) {
-        instance = new ExternInstance(this, t);
+        instance = allocate<ExternInstance>(this, t);
     } else if (type->is<IR::Type_Void>()) {
-        instance = new VoidResult();
+        instance = allocate<VoidResult>(this);
     } else if (type->is<IR::Type_Base>()) {
-        instance = new Z3Bitvector(this, type, gen_z3_expr(name, type));
+        instance = allocate<Z3Bitvector>(this, type, gen_z3_expr(name, type));
     } else {
         P4C_UNIMPLEMENTED(
             "Instance generation for %s of type \"%s\" not supported!.", type,
             type->node_type_name());
     }
+    if (const auto *sb = instance->to<StructBase>()) {
+        cache_prototype(type, sb);
+    }
     return instance;
 }
 
+// Whether a copy of the instance can take any name through rename.
+static bool is_renamable(const P4Z3Instance *instance) {
+    // List and tuple members are named after the list.
+    if (instance->is<ListInstance>() || instance->is<TupleInstance>()) {
+        return false;
+    }
+    if (instance->is<EnumBase>()) {
+        return true;
+    }
+    if (const auto *sb = instance->to<StructBase>()) {
+        for (const auto *member : sb->get_members()) {
+            if (!is_renamable(member)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return instance->is<Z3Bitvector>();
+}
+
+void P4State::cache_prototype(const IR::Type *type,
+                              const StructBase *instance) {
+    if (const auto *ts = type->to<IR::Type_StructLike>()) {
+        if (!is_declared_type(ts)) {
+            return;
+        }
+    } else if (const auto *ts = type->to<IR::Type_Stack>()) {
+        // Stacks are keyed by their IR node, which is only stable if the
+        // program spells out the element type.
+        if (!ts->elementType->is<IR::Type_Name>() || !is_global_type(ts)) {
+            return;
+        }
+    } else if (type->is<IR::Type_Enum>() || type->is<IR::Type_Error>() ||
+               type->is<IR::Type_SerEnum>()) {
+        // Enums copy the declaration of their name, which must be this type.
+        // New members clear the prototypes.
+        const auto *td = type->checkedTo<IR::Type_Declaration>();
+        if (check_for_type(td->name.name) != type) {
+            return;
+        }
+    } else {
+        return;
+    }
+    if (!is_renamable(instance)) {
+        return;
+    }
+    // The caller may modify the generated instance, keep a separate copy.
+    prototype_cache.emplace(type, instance->copy()->to<StructBase>());
+}
+
+void P4State::declare_builtin_decls() {
+    // These two labels are part of the built in declarations.
+    // We only need to add them once.
+    declare_static_decl(
+        IR::ParserState::accept,
+        allocate<P4Declaration>(this, new IR::ReturnStatement(nullptr)));
+    declare_static_decl(
+        IR::ParserState::reject,
+        allocate<P4Declaration>(this, new IR::ExitStatement()));
+}
+
+void P4State::reset(z3::context *context) {
+    scopes.clear();
+    main_scope = P4Scope();
+    expr_result = nullptr;
+    owned_vars.clear();
+    is_exited = false;
+    exit_states.clear();
+    type_name_cache.clear();
+    layout_cache.clear();
+    prototype_cache.clear();
+    undefined_ids.clear();
+    undefined_vars.clear();
+    // Nothing refers to the instances anymore.
+    arena.clear();
+    ctx = context;
+    exit_cond = ctx->bool_val(true);
+    declare_builtin_decls();
+}
+
 void P4State::push_scope() { scopes.push_back(P4Scope()); }
 
 void P4State::pop_scope() { scopes.pop_back(); }
@@ -562,6 +667,10 @@ void P4State::pop_scope() { scopes.pop_back(); }
 void P4State::add_type(cstring type_name, const IR::Type *t) {
     if (check_for_type(type_name) != nullptr) {
         warning("Type %s shadows existing type in target scope.", type_name);
+        // Cached names may now resolve to the new type.
+        type_name_cache.clear();
+        layout_cache.clear();
+        prototype_cache.clear();
     }
     if (scopes.empty()) {
         main_scope.add_type(type_name, t);
@@ -571,20 +680,49 @@ void P4State::add_type(cstring type_name, const IR::Type *t) {
     }
 }
 
-const IR::Type *P4State::get_type(cstring type_name) const {
+const IR::Type *P4State::find_type(cstring type_name,
+                                   const P4Scope **owner_scope) const {
     for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_type(type_name)) {
-            return scope.get_type(type_name);
+        if (const auto *type = scope.find_type(type_name)) {
+            *owner_scope = &scope;
+            return type;
         }
     }
     // also check the parent scope
-    return main_scope.get_type(type_name);
+    *owner_scope = &main_scope;
+    return main_scope.find_type(type_name);
+}
+
+const IR::Type *P4State::get_type(cstring type_name) const {
+    const P4Scope *owner_scope = nullptr;
+    if (const auto *type = find_type(type_name, &owner_scope)) {
+        return type;
+    }
+    BUG("Key %s not found in scope type map.", type_name);
+}
+
+const IR::Type *P4State::resolve_type_name(const IR::Type_Name *tn) const {
+    auto it = type_name_cache.find(tn);
+    if (it != type_name_cache.end()) {
+        return it->second;
+    }
+    const P4Scope *owner_scope = nullptr;
+    cstring type_name = tn->path->name.name;
+    const auto *type = find_type(type_name, &owner_scope);
+    if (type == nullptr) {
+        BUG("Key %s not found in scope type map.", type_name);
+    }
+    // Local scopes bind type parameters per call, only global types are
+    // stable enough to cache.
+    if (owner_scope == &main_scope) {
+        type_name_cache.emplace(tn, type);
+    }
+    return type;
 }
 
 const IR::Type *P4State::resolve_type(const IR::Type *type) const {
     if (const auto *tn = type->to<IR::Type_Name>()) {
-        cstring type_name = tn->path->name.name;
-        type = get_type(type_name);
+        type = resolve_type_name(tn);
     }
     if (const auto *ts = type->to<IR::Type_Specialized>()) {
         TypeSpecializer specializer(*this, *ts->arguments);
@@ -594,19 +732,71 @@ const IR::Type *P4State::resolve_type(const IR::Type *type) const {
     return type;
 }
 
-const IR::Type *P4State::check_for_type(cstring type_name) const {
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_type(type_name)) {
-            return scope.get_type(type_name);
+bool P4State::is_global_type(const IR::Type *type) const {
+    if (const auto *tn = type->to<IR::Type_Name>()) {
+        const P4Scope *owner_scope = nullptr;
+        const auto *resolved_type =
+            find_type(tn->path->name.name, &owner_scope);
+        return resolved_type != nullptr && owner_scope == &main_scope;
+    }
+    if (const auto *ts = type->to<IR::Type_Stack>()) {
+        return is_global_type(ts->elementType);
+    }
+    if (const auto *tt = type->to<IR::Type_Tuple>()) {
+        for (const auto *component : tt->components) {
+            if (!is_global_type(component)) {
+                return false;
+            }
         }
+        return true;
     }
-    // also check the parent scope
-    if (main_scope.has_type(type_name)) {
-        return main_scope.get_type(type_name);
+    if (const auto *tl = type->to<IR::Type_List>()) {
+        for (const auto *component : tl->components) {
+            if (!is_global_type(component)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Type arguments may refer to local type parameters.
+    return !type->is<IR::Type_Specialized>();
+}
+
+std::shared_ptr<StructLayout>
+P4State::find_layout(const IR::Type_StructLike *type) const {
+    auto it = layout_cache.find(type);
+    if (it != layout_cache.end()) {
+        return it->second;
     }
     return nullptr;
 }
 
+bool P4State::is_declared_type(const IR::Type_StructLike *type) const {
+    // Specialized types are generated again for every resolution, only the
+    // declaration itself is stable.
+    if (check_for_type(type->name.name) != type) {
+        return false;
+    }
+    for (const auto *field : type->fields) {
+        if (!is_global_type(field->type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void P4State::cache_layout(const IR::Type_StructLike *type,
+                           std::shared_ptr<StructLayout> layout) {
+    if (layout != nullptr && is_declared_type(type)) {
+        layout_cache.emplace(type, std::move(layout));
+    }
+}
+
+const IR::Type *P4State::check_for_type(cstring type_name) const {
+    const P4Scope *owner_scope = nullptr;
+    return find_type(type_name, &owner_scope);
+}
+
 const IR::Type *P4State::check_for_type(const IR::Type *t) const {
     if (const auto *tn = t->to<IR::Type_Name>()) {
         return check_for_type(tn->path->name.name);
@@ -614,59 +804,69 @@ const IR::Type *P4State::check_for_type(const IR::Type *t) const {
     return t;
 }
 
-P4Z3Instance *P4State::get_var(cstring name) const {
+const VarMap::mapped_type *P4State::find_var_entry(cstring name) const {
     for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_var(name)) {
-            return scope.get_var(name);
+        if (const auto *entry = scope.find_var(name)) {
+            return entry;
         }
     }
     // also check the parent scope
-    if (main_scope.has_var(name)) {
-        return main_scope.get_var(name);
+    return main_scope.find_var(name);
+}
+
+P4Z3Instance *P4State::get_var(cstring name) const {
+    if (const auto *entry = find_var_entry(name)) {
+        return entry->first;
     }
-    error("Variable %s not found in scope.", name);
-    exit(1);
+    FATAL_ERROR("Variable %s not found in scope.", name);
 }
 
-const IR::Type *P4State::get_var_type(cstring name) const {
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_var(name)) {
-            return scope.get_var_type(name);
-        }
+P4Z3Instance *P4State::get_mut_var(cstring name) {
+    P4Scope *target_scope = nullptr;
+    auto *var = find_var(name, &target_scope);
+    if (target_scope == nullptr) {
+        FATAL_ERROR("Variable %s not found in scope.", name);
     }
-    // also check the parent scope
-    if (main_scope.has_var(name)) {
-        return main_scope.get_var_type(name);
+    return own_var(target_scope, name, var);
+}
+
+P4Z3Instance *P4State::own_var(P4Scope *scope, cstring name,
+                               P4Z3Instance *var) {
+    // The instance may still be referenced by a saved state, copy it first.
+    if (owned_vars.count(var) == 0) {
+        var = var->copy();
+        scope->update_var(name, var);
+        owned_vars.insert(var);
+    }
+    return var;
+}
+
+const IR::Type *P4State::get_var_type(cstring name) const {
+    if (const auto *entry = find_var_entry(name)) {
+        return entry->second;
     }
-    error("Variable %s not found in scope.", name);
-    exit(1);
+    FATAL_ERROR("Variable %s not found in scope.", name);
 }
 
 P4Z3Instance *P4State::find_var(cstring name, P4Scope **owner_scope) {
     for (int64_t i = scopes.size() - 1; i >= 0; --i) {
         auto *scope = &scopes.at(i);
-        if (scope->has_var(name)) {
+        if (const auto *entry = scope->find_var(name)) {
             *owner_scope = scope;
-            return scope->get_var(name);
+            return entry->first;
         }
     }
     // also check the parent scope
-    if (main_scope.has_var(name)) {
+    if (const auto *entry = main_scope.find_var(name)) {
         *owner_scope = &main_scope;
-        return main_scope.get_var(name);
+        return entry->first;
     }
     return nullptr;
 }
 
 P4Z3Instance *P4State::find_var(cstring name) const {
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_var(name)) {
-            return scope.get_var(name);
-        }
-    }
-    // also check the parent scope
-    if (main_scope.has_var(name)) {
-        return main_scope.get_var(name);
+    if (const auto *entry = find_var_entry(name)) {
+        return entry->first;
     }
     return nullptr;
 }
@@ -689,47 +889,38 @@ void P4State::declare_var(cstring name, P4Z3Instance *var,
     } else {
         get_mut_current_scope()->declare_var(name, var, decl_type);
     }
+    owned_vars.insert(var);
 }
 
 const P4Declaration *P4State::get_static_decl(cstring name) const {
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_static_decl(name)) {
-            return scope.get_static_decl(name);
-        }
+    if (const auto *decl = find_static_decl(name)) {
+        return decl;
     }
-    // also check the parent scope
-    if (main_scope.has_static_decl(name)) {
-        return main_scope.get_static_decl(name);
-    }
-    error("Static Declaration %s not found in scope.", name);
-    exit(1);
+    FATAL_ERROR("Static Declaration %s not found in scope.", name);
 }
 
 P4Declaration *P4State::find_static_decl(cstring name) const {
     for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        if (scope.has_static_decl(name)) {
-            return scope.get_static_decl(name);
+        if (auto *decl = scope.find_static_decl(name)) {
+            return decl;
         }
     }
     // also check the parent scope
-    if (main_scope.has_static_decl(name)) {
-        return main_scope.get_static_decl(name);
-    }
-    return nullptr;
+    return main_scope.find_static_decl(name);
 }
 
 P4Declaration *P4State::find_static_decl(cstring name, P4Scope **owner_scope) {
     for (int64_t i = scopes.size() - 1; i >= 0; --i) {
         auto *scope = &scopes.at(i);
-        if (scope->has_static_decl(name)) {
+        if (auto *decl = scope->find_static_decl(name)) {
             *owner_scope = scope;
-            return scope->get_static_decl(name);
+            return decl;
         }
     }
     // also check the parent scope
-    if (main_scope.has_static_decl(name)) {
+    if (auto *decl = main_scope.find_static_decl(name)) {
         *owner_scope = &main_scope;
-        return main_scope.get_static_decl(name);
+        return decl;
     }
     return nullptr;
 }
@@ -749,74 +940,75 @@ void P4State::declare_static_decl(cstring name, P4Declaration *decl) {
     }
 }
 
-ProgState P4State::clone_state() const {
-    auto cloned_state = ProgState();
-
-    for (const auto &scope : scopes) {
-        cloned_state.push_back(scope.clone());
-    }
-    return cloned_state;
+ProgState P4State::clone_state() {
+    // Scopes share their variable maps, so copying them is cheap.
+    // Every instance is now also referenced by the snapshot.
+    owned_vars.clear();
+    return scopes;
 }
 
-VarMap P4State::clone_vars() const {
-    VarMap cloned_vars;
-    // this also implicitly shadows
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        auto sub_vars = scope.clone_vars();
-        cloned_vars.insert(sub_vars.begin(), sub_vars.end());
-    }
-    return cloned_vars;
-}
-
-VarMap P4State::get_vars() const {
-    VarMap concat_map;
-    // this also implicitly shadows
-    for (const auto &scope : boost::adaptors::reverse(scopes)) {
-        auto sub_vars = scope.get_var_map();
-        concat_map.insert(sub_vars.begin(), sub_vars.end());
-    }
-    return concat_map;
+VarSnapshot P4State::clone_vars() {
+    owned_vars.clear();
+    return get_vars();
 }
 
-void P4State::restore_vars(const VarMap &input_map) {
-    for (const auto &map_tuple : input_map) {
-        update_var(map_tuple.first, map_tuple.second.first);
+VarSnapshot P4State::get_vars() const {
+    VarSnapshot snapshot;
+    snapshot.reserve(scopes.size());
+    for (const auto &scope : scopes) {
+        snapshot.push_back(scope.get_var_map());
     }
+    return snapshot;
 }
 
-void P4State::merge_vars(const z3::expr &cond, const VarMap &then_map) {
-    for (const auto &map_tuple : get_vars()) {
-        const auto else_name = map_tuple.first;
-        auto *instance = map_tuple.second.first;
-        // TODO: This check should not be necessary
-        // Find a cleaner way using scopes
-        auto then_instance = then_map.find(else_name);
-        if (then_instance != then_map.end()) {
-            instance->merge(cond, *then_instance->second.first);
+void P4State::restore_vars(const VarSnapshot &snapshot) {
+    auto num_scopes = std::min(scopes.size(), snapshot.size());
+    for (size_t idx = 0; idx < num_scopes; ++idx) {
+        auto *scope = &scopes[idx];
+        const auto &input_map = snapshot[idx];
+        // The scope has not changed since the snapshot.
+        if (scope->get_var_map().shares_storage(input_map)) {
+            continue;
+        }
+        for (const auto &map_tuple : input_map) {
+            const auto name = map_tuple.first;
+            auto *var = map_tuple.second.first;
+            // Skip unchanged variables to avoid copying shared maps.
+            const auto *entry = scope->find_var(name);
+            if (entry != nullptr && entry->first != var) {
+                scope->update_var(name, var);
+            }
         }
     }
 }
 
-void merge_var_maps(const z3::expr &cond, const VarMap &then_map,
-                    const VarMap &else_map) {
-    for (const auto &then_tuple : then_map) {
-        const auto then_name = then_tuple.first;
-        auto *then_var = then_tuple.second.first;
-        // TODO: This check should not be necessary
-        // Find a cleaner way using scopes
-        auto else_var = else_map.find(then_name);
-        if (else_var != else_map.end()) {
-            then_var->merge(cond, *else_var->second.first);
+void P4State::merge_vars(const z3::expr &cond, const VarSnapshot &then_vars) {
+    auto num_scopes = std::min(scopes.size(), then_vars.size());
+    for (size_t idx = 0; idx < num_scopes; ++idx) {
+        auto *scope = &scopes[idx];
+        const auto &then_map = then_vars[idx];
+        // Both branches share the whole scope, nothing to merge.
+        if (scope->get_var_map().shares_storage(then_map)) {
+            continue;
+        }
+        // Merging may duplicate the map of the scope, iterate a copy.
+        auto else_map = scope->get_var_map();
+        for (const auto &map_tuple : else_map) {
+            const auto else_name = map_tuple.first;
+            auto *instance = map_tuple.second.first;
+            // Variables declared after the snapshot are not merged.
+            auto then_instance = then_map.find(else_name);
+            if (then_instance == then_map.end()) {
+                continue;
+            }
+            // Both branches share the same instance, nothing to merge.
+            if (then_instance->second.first == instance) {
+                continue;
+            }
+            instance = own_var(scope, else_name, instance);
+            instance->merge(cond, *then_instance->second.first);
         }
     }
 }
 
-void P4State::merge_state(const z3::expr &cond, const ProgState &else_state) {
-    for (size_t i = 0; i < scopes.size(); ++i) {
-        auto *then_scope = &scopes[i];
-        const auto *else_scope = &else_state.at(i);
-        merge_var_maps(cond, then_scope->get_var_map(),
-                       else_scope->get_var_map());
-    }
-}
 }  // namespace TOZ3
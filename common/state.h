@@ -9,12 +9,15 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "../contrib/z3/z3++.h"
+#include "arena.h"
 #include "ir/ir.h"
 #include "scope.h"
+#include "type_layout.h"
 
 namespace TOZ3 {
 
@@ -25,20 +28,49 @@ get_hdr_pairs(P4State *state, const MemberStruct &member_struct);
 
 class P4State {
  private:
+    // Owns all instances of this state. Allocating does not change the
+    // interpretation, so const instances may allocate their results.
+    mutable InstanceArena arena;
     ProgState scopes;
     P4Scope main_scope;
     z3::context *ctx;
     P4Z3Instance *expr_result = nullptr;
+    // Instances created after the last snapshot of the state.
+    // Only these may be modified in place, all others are shared.
+    std::set<const P4Z3Instance *> owned_vars;
+    // Type names which resolved to a global type, keyed by their IR node.
+    mutable std::unordered_map<const IR::Type_Name *, const IR::Type *>
+        type_name_cache;
+    // Layouts of struct-like types whose fields only refer to global types.
+    std::unordered_map<const IR::Type *, std::shared_ptr<StructLayout>>
+        layout_cache;
+    // Template instances of struct-like types, stacks and enums. Generating
+    // such an instance copies and renames its prototype instead of building
+    // it.
+    std::unordered_map<const IR::Type *, const StructBase *> prototype_cache;
+    // Constants that stand for undefined values, recorded when they are
+    // created. Keyed by the id of their declaration.
+    mutable std::set<unsigned> undefined_ids;
+    mutable std::vector<z3::expr> undefined_vars;
     // Exit vars
     bool is_exited = false;
-    std::vector<std::pair<z3::expr, VarMap>> exit_states;
+    std::vector<std::pair<z3::expr, VarSnapshot>> exit_states;
     z3::expr exit_cond = ctx->bool_val(true);
     P4Scope *get_mut_current_scope() { return &scopes.back(); }
     void set_var(Visitor *visitor, const IR::Expression *target,
                  P4Z3Instance *rval);
     P4Declaration *find_static_decl(cstring name, P4Scope **owner_scope);
     P4Z3Instance *find_var(cstring name, P4Scope **owner_scope);
-    const IR::Type *find_type(cstring type_name, P4Scope **owner_scope);
+    // Returns an instance of the variable that may be modified in place.
+    P4Z3Instance *own_var(P4Scope *scope, cstring name, P4Z3Instance *var);
+    const IR::Type *find_type(cstring type_name,
+                              const P4Scope **owner_scope) const;
+    const VarMap::mapped_type *find_var_entry(cstring name) const;
+    const IR::Type *resolve_type_name(const IR::Type_Name *tn) const;
+    bool is_global_type(const IR::Type *type) const;
+    bool is_declared_type(const IR::Type_StructLike *type) const;
+    void cache_prototype(const IR::Type *type, const StructBase *instance);
+    void declare_builtin_decls();
 
  public:
     const P4Scope &get_current_scope() const { return scopes.back(); }
@@ -46,14 +78,16 @@ class P4State {
     void set_exit(bool exit_state) { is_exited = exit_state; }
 
     explicit P4State(z3::context *context) : ctx(context) {
-        // These two labels are part of the built in declarations.
-        // We only need to add them once.
-        declare_static_decl(
-            IR::ParserState::accept,
-            new P4Declaration(new IR::ReturnStatement(nullptr)));
-        declare_static_decl(IR::ParserState::reject,
-                            new P4Declaration(new IR::ExitStatement()));
+        declare_builtin_decls();
     }
+    P4State(const P4State &) = delete;
+    P4State &operator=(const P4State &) = delete;
+    // Releases all instances and scopes, so the state can interpret the next
+    // program. Instances of the previous program must not be used anymore.
+    void reset() { reset(ctx); }
+    // Like reset, but the next program is interpreted in another context.
+    // The old context may be deleted afterwards.
+    void reset(z3::context *context);
 
     /****** GETTERS ******/
     ProgState get_state() const { return scopes; }
@@ -66,7 +100,23 @@ class P4State {
         BUG("Could not cast to type %s.", typeid(T).name());
     }
     /****** ALLOCATIONS ******/
+    // Instances live as long as this state or until it is reset.
+    template <typename T, typename... Args>
+    T *allocate(Args &&...args) const {
+        return arena.allocate<T>(std::forward<Args>(args)...);
+    }
+    size_t get_num_instances() const { return arena.get_num_instances(); }
+    size_t get_num_bytes() const { return arena.get_num_bytes(); }
     z3::expr gen_z3_expr(cstring name, const IR::Type *type);
+    /****** UNDEFINED VALUES ******/
+    void record_undefined(const z3::expr &var) const {
+        if (undefined_ids.insert(var.decl().id()).second) {
+            undefined_vars.push_back(var);
+        }
+    }
+    const std::vector<z3::expr> &get_undefined_vars() const {
+        return undefined_vars;
+    }
     P4Z3Instance *gen_instance(cstring name, const IR::Type *type,
                                uint64_t id = 0);
 
@@ -108,13 +158,14 @@ class P4State {
     /****** SCOPES AND STATES ******/
     void push_scope();
     void pop_scope();
-    void merge_state(const z3::expr &cond, const ProgState &else_state);
     void restore_state(const ProgState &set_scopes) { scopes = set_scopes; }
-    ProgState clone_state() const;
-    VarMap get_vars() const;
-    VarMap clone_vars() const;
-    void restore_vars(const VarMap &input_map);
-    void merge_vars(const z3::expr &cond, const VarMap &other);
+    ProgState clone_state();
+    // Snapshots are restored and merged scope by scope, matched by their
+    // position on the stack. Scopes deeper than the current stack are ignored.
+    VarSnapshot get_vars() const;
+    VarSnapshot clone_vars();
+    void restore_vars(const VarSnapshot &snapshot);
+    void merge_vars(const z3::expr &cond, const VarSnapshot &then_vars);
     z3::expr get_exit_cond() const { return exit_cond; }
     void set_exit_cond(const z3::expr &forward_cond) {
         exit_cond = forward_cond;
@@ -130,7 +181,7 @@ class P4State {
         exit_cond = ctx->bool_val(true);
         is_exited = false;
     }
-    void add_exit_state(const z3::expr &cond, const VarMap &exit_state) {
+    void add_exit_state(const z3::expr &cond, const VarSnapshot &exit_state) {
         exit_states.emplace_back(cond, exit_state);
     }
     std::vector<z3::expr> get_forward_conds() const {
@@ -172,10 +223,10 @@ class P4State {
     std::vector<std::pair<z3::expr, P4Z3Instance *>> get_return_exprs() {
         return get_mut_current_scope()->get_return_exprs();
     }
-    void push_return_state(const z3::expr &cond, const VarMap &state) {
+    void push_return_state(const z3::expr &cond, const VarSnapshot &state) {
         return get_mut_current_scope()->push_return_state(cond, state);
     }
-    std::vector<std::pair<z3::expr, VarMap>> get_return_states() const {
+    std::vector<std::pair<z3::expr, VarSnapshot>> get_return_states() const {
         return get_current_scope().get_return_states();
     }
 
@@ -185,6 +236,13 @@ class P4State {
     const IR::Type *get_type(cstring type_name) const;
     const IR::Type *check_for_type(cstring type_name) const;
     const IR::Type *check_for_type(const IR::Type *t) const;
+    // Returns nullptr if no instance of this type has been generated yet.
+    std::shared_ptr<StructLayout>
+    find_layout(const IR::Type_StructLike *type) const;
+    // Keeps the layout for later instances, unless it depends on the scope.
+    void cache_layout(const IR::Type_StructLike *type,
+                      std::shared_ptr<StructLayout> layout);
+    void clear_prototypes() { prototype_cache.clear(); }
 
     /****** VARIABLES ******/
     P4Z3Instance *find_var(cstring name) const;
@@ -192,6 +250,7 @@ class P4State {
     void declare_var(cstring name, P4Z3Instance *var,
                      const IR::Type *decl_type);
     P4Z3Instance *get_var(cstring name) const;
+    P4Z3Instance *get_mut_var(cstring name);
     template <typename T> const T *get_var(cstring name) const {
         const auto *var = get_var(name);
         return var->to<T>();
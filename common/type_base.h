@@ -1,16 +1,20 @@
 #ifndef TOZ3_COMMON_TYPE_BASE_H_
 #define TOZ3_COMMON_TYPE_BASE_H_
 
+#include <cstdint>
 #include <cstdio>
 
 #include <map>      // std::map
-#include <stack>    // std::stack
-#include <utility>  // std::pair
-#include <vector>   // std::vector
+#include <memory>   // std::shared_ptr
+#include <stack>        // std::stack
+#include <type_traits>  // std::integral_constant
+#include <utility>      // std::pair
+#include <vector>       // std::vector
 
 #include "../contrib/z3/z3++.h"
 #include "ir/ir.h"
 #include "lib/cstring.h"
+#include "name_map.h"
 #include "util.h"
 
 #define BOOST_VARIANT_USE_RELAXED_GET_BY_DEFAULT
@@ -20,18 +24,106 @@
 
 namespace TOZ3 {
 
+class NumericVal;
 class Z3Int;
 class Z3Bitvector;
 class VoidResult;
+class StructBase;
 class StructInstance;
 class HeaderInstance;
+class IndexableInstance;
+class StackInstance;
+class TupleInstance;
 class HeaderUnionInstance;
+class EnumBase;
 class EnumInstance;
 class ErrorInstance;
 class SerEnumInstance;
 class ListInstance;
-class ExternInstance;
+class ControlInstance;
+class P4Declaration;
 class P4TableInstance;
+class ExternInstance;
+
+// Kind tags of the instance classes, numbered in pre-order of the class
+// hierarchy. The kinds of a class and all its subclasses form a range.
+enum class P4Z3Kind : uint8_t {
+    Unknown,
+    VoidResult,
+    NumericVal,
+    Z3Bitvector,
+    Z3Int,
+    StructBase,
+    StructInstance,
+    HeaderInstance,
+    IndexableInstance,
+    StackInstance,
+    TupleInstance,
+    HeaderUnionInstance,
+    EnumBase,
+    EnumInstance,
+    ErrorInstance,
+    SerEnumInstance,
+    ListInstance,
+    ControlInstance,
+    P4Declaration,
+    P4TableInstance,
+    ExternInstance,
+};
+
+// Classes without a kind range, such as the mixins, fall back to dynamic_cast.
+template <typename T> struct P4Z3KindRange {
+    static constexpr bool tagged = false;
+    static constexpr P4Z3Kind first = P4Z3Kind::Unknown;
+    static constexpr P4Z3Kind last = P4Z3Kind::Unknown;
+};
+template <P4Z3Kind First, P4Z3Kind Last = First> struct TaggedKindRange {
+    static constexpr bool tagged = true;
+    static constexpr P4Z3Kind first = First;
+    static constexpr P4Z3Kind last = Last;
+};
+// clang-format off
+template <> struct P4Z3KindRange<VoidResult>
+    : TaggedKindRange<P4Z3Kind::VoidResult> {};
+template <> struct P4Z3KindRange<NumericVal>
+    : TaggedKindRange<P4Z3Kind::NumericVal, P4Z3Kind::Z3Int> {};
+template <> struct P4Z3KindRange<Z3Bitvector>
+    : TaggedKindRange<P4Z3Kind::Z3Bitvector> {};
+template <> struct P4Z3KindRange<Z3Int>
+    : TaggedKindRange<P4Z3Kind::Z3Int> {};
+template <> struct P4Z3KindRange<StructBase>
+    : TaggedKindRange<P4Z3Kind::StructBase, P4Z3Kind::ListInstance> {};
+template <> struct P4Z3KindRange<StructInstance>
+    : TaggedKindRange<P4Z3Kind::StructInstance, P4Z3Kind::HeaderInstance> {};
+template <> struct P4Z3KindRange<HeaderInstance>
+    : TaggedKindRange<P4Z3Kind::HeaderInstance> {};
+template <> struct P4Z3KindRange<IndexableInstance>
+    : TaggedKindRange<P4Z3Kind::IndexableInstance, P4Z3Kind::TupleInstance> {};
+template <> struct P4Z3KindRange<StackInstance>
+    : TaggedKindRange<P4Z3Kind::StackInstance> {};
+template <> struct P4Z3KindRange<TupleInstance>
+    : TaggedKindRange<P4Z3Kind::TupleInstance> {};
+template <> struct P4Z3KindRange<HeaderUnionInstance>
+    : TaggedKindRange<P4Z3Kind::HeaderUnionInstance> {};
+template <> struct P4Z3KindRange<EnumBase>
+    : TaggedKindRange<P4Z3Kind::EnumBase, P4Z3Kind::SerEnumInstance> {};
+template <> struct P4Z3KindRange<EnumInstance>
+    : TaggedKindRange<P4Z3Kind::EnumInstance> {};
+template <> struct P4Z3KindRange<ErrorInstance>
+    : TaggedKindRange<P4Z3Kind::ErrorInstance> {};
+template <> struct P4Z3KindRange<SerEnumInstance>
+    : TaggedKindRange<P4Z3Kind::SerEnumInstance> {};
+template <> struct P4Z3KindRange<ListInstance>
+    : TaggedKindRange<P4Z3Kind::ListInstance> {};
+template <> struct P4Z3KindRange<ControlInstance>
+    : TaggedKindRange<P4Z3Kind::ControlInstance> {};
+template <> struct P4Z3KindRange<P4Declaration>
+    : TaggedKindRange<P4Z3Kind::P4Declaration, P4Z3Kind::P4TableInstance> {};
+template <> struct P4Z3KindRange<P4TableInstance>
+    : TaggedKindRange<P4Z3Kind::P4TableInstance> {};
+template <> struct P4Z3KindRange<ExternInstance>
+    : TaggedKindRange<P4Z3Kind::ExternInstance> {};
+// clang-format on
 
 using P4Z3Function =
     std::function<void(Visitor *, const IR::Vector<IR::Argument> *)>;
@@ -75,12 +167,53 @@ struct TableProperties {
 };
 
 class P4Z3Node {
+ private:
+    // Set by the constructors of the tagged classes. The constructor of the
+    // most derived class runs last, so it decides the kind.
+    P4Z3Kind kind = P4Z3Kind::Unknown;
+
+    template <typename T> const T *to(std::true_type /*tagged*/) const {
+        if (kind == P4Z3Kind::Unknown) {
+            return dynamic_cast<const T *>(this);
+        }
+        const T *result = nullptr;
+        if (kind >= P4Z3KindRange<T>::first &&
+            kind <= P4Z3KindRange<T>::last) {
+            result = static_cast<const T *>(this);
+        }
+#ifndef NDEBUG
+        // The kind ranges must mirror the class hierarchy.
+        BUG_CHECK(result == dynamic_cast<const T *>(this),
+                  "Kind %s of %s disagrees with its class.",
+                  static_cast<int>(kind), get_static_type());
+#endif
+        return result;
+    }
+    template <typename T> const T *to(std::false_type /*tagged*/) const {
+        return dynamic_cast<const T *>(this);
+    }
+
+ protected:
+    void set_kind(P4Z3Kind new_kind) { kind = new_kind; }
+
  public:
+    P4Z3Node() = default;
+    // Copies keep the kind of the object they copy. A sliced copy would keep
+    // the kind of the derived class, the debug check in to<T> catches it.
+    P4Z3Node(const P4Z3Node &other) : kind(other.kind) {}
+    // The kind belongs to the object, assigning a value keeps it.
+    P4Z3Node &operator=(const P4Z3Node & /*other*/) { return *this; }
+    virtual ~P4Z3Node() = default;
+
+    P4Z3Kind get_kind() const { return kind; }
     template <typename T> bool is() const { return to<T>() != nullptr; }
     template <typename T> const T *to() const {
-        return dynamic_cast<const T *>(this);
+        return to<T>(
+            std::integral_constant<bool, P4Z3KindRange<T>::tagged>());
+    }
+    template <typename T> T *to_mut() {
+        return const_cast<T *>(static_cast<const P4Z3Node *>(this)->to<T>());
     }
-    template <typename T> T *to_mut() { return dynamic_cast<T *>(this); }
 
     virtual cstring get_static_type() const = 0;
     virtual cstring to_string() const = 0;
@@ -135,7 +268,7 @@ class P4Z3Instance : public P4Z3Node {
 
  public:
     explicit P4Z3Instance(const IR::Type *p4_type) : p4_type(p4_type) {}
-    ~P4Z3Instance() = default;
+    ~P4Z3Instance() override = default;
 
     const IR::Type *get_p4_type() const { return p4_type; }
     /****** UNARY OPERANDS ******/
@@ -248,8 +381,48 @@ class P4Z3Instance : public P4Z3Node {
     P4Z3Instance(const P4Z3Instance &other) { p4_type = other.p4_type; }
 };
 
-using VarMap =
-    ordered_map<cstring, std::pair<P4Z3Instance *, const IR::Type *>>;
+// Maps variable names to their instance and declared type.
+// Copies of a VarMap share the same storage, which is only duplicated once a
+// shared map is modified. This keeps snapshots of the program state cheap.
+class VarMap {
+ private:
+    using Storage =
+        NameMap<std::pair<P4Z3Instance *, const IR::Type *>>;
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+
+    Storage *get_mut_storage() {
+        if (storage.use_count() > 1) {
+            storage = std::make_shared<Storage>(*storage);
+        }
+        return storage.get();
+    }
+
+ public:
+    using value_type = Storage::value_type;
+    using mapped_type = Storage::mapped_type;
+    using const_iterator = Storage::const_iterator;
+
+    const_iterator begin() const { return storage->begin(); }
+    const_iterator end() const { return storage->end(); }
+    const_iterator find(cstring name) const { return storage->find(name); }
+    size_t count(cstring name) const { return storage->count(name); }
+    size_t size() const { return storage->size(); }
+    bool empty() const { return storage->empty(); }
+    // True if neither map has been modified since one was copied from the
+    // other.
+    bool shares_storage(const VarMap &other) const {
+        return storage == other.storage;
+    }
+
+    mapped_type &at(cstring name) { return get_mut_storage()->at(name); }
+    mapped_type &operator[](cstring name) {
+        return (*get_mut_storage())[name];
+    }
+    void insert(const value_type &value) { get_mut_storage()->insert(value); }
+    template <typename InputIt> void insert(InputIt first, InputIt last) {
+        get_mut_storage()->insert(first, last);
+    }
+};
 using MainResult =
     ordered_map<cstring, std::pair<std::vector<std::pair<cstring, z3::expr>>,
                                    const IR::Type *>>;
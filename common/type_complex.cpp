@@ -24,33 +24,52 @@ StructBase::StructBase(P4State *state, const IR::Type *type, cstring name,
                        uint64_t member_id)
     : P4Z3Instance(type), state(state),
       valid(state->get_z3_ctx()->bool_val(true)), instance_name(name) {
+    set_kind(P4Z3Kind::StructBase);
     width = 0;
 }
 
 StructBase::StructBase(const StructBase &other)
-    : P4Z3Instance(other), valid(other.valid) {
+    : P4Z3Instance(other), state(other.state), layout(other.layout),
+      valid(other.valid) {
     width = other.width;
-    state = other.state;
     instance_name = other.instance_name;
-    member_types = other.member_types;
-    for (auto value_tuple : other.members) {
-        cstring name = value_tuple.first;
-        auto *member_cpy = value_tuple.second->copy();
-        insert_member(name, member_cpy);
+    members.reserve(other.members.size());
+    for (const auto *member : other.members) {
+        members.push_back(member->copy());
+    }
+}
+
+void StructBase::insert_member(cstring name, P4Z3Instance *val,
+                               const IR::Type *type) {
+    if (layout == nullptr) {
+        layout = std::make_shared<StructLayout>();
+    } else if (layout.use_count() > 1) {
+        layout = std::make_shared<StructLayout>(*layout);
+    }
+    uint64_t member_width = 0;
+    bool is_signed = false;
+    if (const auto *si = val->to<StructBase>()) {
+        member_width = si->get_width();
+    } else if (const auto *z3_var = val->to<Z3Bitvector>()) {
+        member_width = z3_var->get_width();
+        is_signed = z3_var->bv_is_signed();
+    }
+    auto idx = layout->add_field(name, type, member_width, is_signed);
+    // Like an ordered map, an existing member is not overwritten.
+    if (idx == members.size()) {
+        members.push_back(val);
     }
 }
 
 void StructBase::set_undefined() {
-    for (auto member_tuple : members) {
-        member_tuple.second->set_undefined();
+    for (auto *member : members) {
+        member->set_undefined();
     }
 }
 
 void StructBase::set_list(std::vector<P4Z3Instance *> input_list) {
-    size_t idx = 0;
-    for (auto &member_tuple : members) {
-        auto member_name = member_tuple.first;
-        auto *target_val = member_tuple.second;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        auto *target_val = members[idx];
         const auto *input_val = input_list.at(idx);
         if (const auto *sub_list = input_val->to<ListInstance>()) {
             if (auto *sub_target = target_val->to_mut<StructBase>()) {
@@ -60,22 +79,24 @@ void StructBase::set_list(std::vector<P4Z3Instance *> input_list) {
                     target_val->get_static_type());
             }
         } else {
+            auto member_name = get_member_name(idx);
             const auto *member_type = get_member_type(member_name);
             auto *cast_val = input_val->cast_allocate(member_type);
             update_member(member_name, cast_val);
         }
-        idx++;
     }
 }
 
 void StructBase::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     const auto *then_struct = then_expr.to<StructBase>();
     BUG_CHECK(then_struct, "Unsupported merge class.");
-    for (auto member_tuple : members) {
-        cstring member_name = member_tuple.first;
-        auto *then_var = member_tuple.second;
-        const auto *else_var = then_struct->get_const_member(member_name);
-        then_var->merge(cond, *else_var);
+    // Instances with the same layout store their members in the same order.
+    bool same_layout = layout == then_struct->layout;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        const auto *else_var =
+            same_layout ? then_struct->members[idx]
+                        : then_struct->get_const_member(get_member_name(idx));
+        members[idx]->merge(cond, *else_var);
     }
 }
 
@@ -95,8 +116,7 @@ void StructBase::propagate_validity(const z3::expr *valid_expr) {
     if (valid_expr != nullptr) {
         valid = *valid_expr;
     }
-    for (auto member_tuple : members) {
-        auto *member = member_tuple.second;
+    for (auto *member : members) {
         if (auto *z3_var = member->to_mut<StructBase>()) {
             z3_var->propagate_validity(valid_expr);
         }
@@ -111,28 +131,29 @@ void StructBase::bind(const z3::expr *bind_var, uint64_t offset) {
     }
     z3::expr tmp_var = state->get_z3_ctx()->bv_const(instance_name, var_width);
     if (bind_var == nullptr) {
+        // The members of an undefined instance are undefined as well.
+        if (instance_name.startsWith(UNDEF_LABEL)) {
+            state->record_undefined(tmp_var);
+        }
         bind_var = &tmp_var;
         offset = var_width;
     }
-    auto bit_idx = offset;
-    for (auto type_tuple : members) {
-        auto member_name = type_tuple.first;
-        auto *member_var = type_tuple.second;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        const auto &field = layout->get_field(idx);
+        // The index of the most significant bit of this member.
+        auto bit_idx = offset - field.offset;
+        auto *member_var = members[idx];
         if (auto *si = member_var->to_mut<StructBase>()) {
             si->bind(bind_var, bit_idx);
-            bit_idx -= si->get_width();
         } else if (const auto *z3_var = member_var->to<Z3Bitvector>()) {
-            auto var_width = z3_var->get_width();
             // TODO: Better casting
             auto extract_var =
-                bind_var->extract(bit_idx - 1, bit_idx - var_width);
+                bind_var->extract(bit_idx - 1, bit_idx - field.width);
             if (z3_var->get_p4_type()->is<IR::Type_Boolean>()) {
                 extract_var = extract_var > 0;
             }
-            auto bind_bv = new Z3Bitvector(state, z3_var->get_p4_type(),
-                                           extract_var, z3_var->bv_is_signed());
-            update_member(member_name, bind_bv);
-            bit_idx -= var_width;
+            members[idx] = state->allocate<Z3Bitvector>(
+                state, z3_var->get_p4_type(), extract_var, field.is_signed);
         } else {
             P4C_UNIMPLEMENTED("Type \"%s\" not supported!.",
                               member_var->get_static_type());
@@ -140,18 +161,29 @@ void StructBase::bind(const z3::expr *bind_var, uint64_t offset) {
     }
 }
 
+void StructBase::rename(cstring name, uint64_t member_id) {
+    instance_name = name;
+    // Bit vector members are undefined and do not carry the name.
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        if (auto *si = members[idx]->to_mut<StructBase>()) {
+            si->rename(name, member_id + layout->get_field(idx).offset);
+        }
+    }
+}
+
 z3::expr StructBase::operator==(const P4Z3Instance &other) const {
     auto is_eq = state->get_z3_ctx()->bool_val(true);
     if (other.is<ListInstance>()) {
         // We might be dealing with a list, flip and use the List implementation
         return other.operator==(*this);
     }
-    if (other.is<StructBase>()) {
-        for (auto member_tuple : members) {
-            auto member_name = member_tuple.first;
-            const auto *member_val = member_tuple.second;
-            const auto *other_val = other.get_member(member_name);
-            is_eq = is_eq && (member_val->operator==(*other_val));
+    if (const auto *other_struct = other.to<StructBase>()) {
+        bool same_layout = layout == other_struct->layout;
+        for (size_t idx = 0; idx < members.size(); ++idx) {
+            const auto *other_val =
+                same_layout ? other_struct->members[idx]
+                            : other.get_member(get_member_name(idx));
+            is_eq = is_eq && (members[idx]->operator==(*other_val));
         }
         return is_eq;
     }
@@ -172,6 +204,23 @@ StructInstance
 StructInstance::StructInstance(P4State *state, const IR::Type_StructLike *type,
                                cstring name, uint64_t member_id)
     : StructBase(state, type, name, member_id) {
+    set_kind(P4Z3Kind::StructInstance);
+    if (auto type_layout = state->find_layout(type)) {
+        // The fields are already resolved, only generate the members.
+        layout = type_layout;
+        members.reserve(layout->size());
+        for (size_t idx = 0; idx < layout->size(); ++idx) {
+            const auto &field = layout->get_field(idx);
+            auto *member_var =
+                state->gen_instance(name, field.type, member_id + field.offset);
+            if (auto *num_val = member_var->to_mut<Z3Bitvector>()) {
+                num_val->set_undefined();
+            }
+            members.push_back(member_var);
+        }
+        width = layout->get_width();
+        return;
+    }
     auto flat_id = member_id;
     for (const auto *field : type->fields) {
         const IR::Type *resolved_type = state->resolve_type(field->type);
@@ -186,13 +235,13 @@ StructInstance::StructInstance(P4State *state, const IR::Type_StructLike *type,
         } else {
             P4C_UNIMPLEMENTED("Type \"%s\" not supported!.", field->type);
         }
-        insert_member(field->name.name, member_var);
-        member_types.insert({field->name.name, resolved_type});
+        insert_member(field->name.name, member_var, resolved_type);
     }
+    state->cache_layout(type, layout);
 }
 
 StructInstance *StructInstance::copy() const {
-    return new StructInstance(*this);
+    return state->allocate<StructInstance>(*this);
 }
 
 std::vector<std::pair<cstring, z3::expr>>
@@ -208,15 +257,15 @@ StructInstance::get_z3_vars(cstring prefix, const z3::expr *valid_expr) const {
         tmp_valid = &valid;
     }
     std::vector<std::pair<cstring, z3::expr>> z3_vars;
-    for (auto member_tuple : members) {
-        cstring name = member_tuple.first;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        const auto &field = layout->get_field(idx);
+        cstring name = field.name;
         if (prefix.size() != 0) {
             name = prefix + "." + name;
         }
-        const auto *member = member_tuple.second;
+        const auto *member = members[idx];
         if (const auto *z3_var = member->to<Z3Bitvector>()) {
-            const auto *dest_type = member_types.at(member_tuple.first);
-            auto invalid_var = state->gen_z3_expr(INVALID_LABEL, dest_type);
+            auto invalid_var = state->gen_z3_expr(INVALID_LABEL, field.type);
             auto valid_var =
                 z3::ite(*tmp_valid, *z3_var->get_val(), invalid_var);
             z3_vars.emplace_back(name, valid_var);
@@ -226,7 +275,7 @@ StructInstance::get_z3_vars(cstring prefix, const z3::expr *valid_expr) const {
                            z3_sub_vars.end());
         } else if (const auto *z3_var = member->to<Z3Int>()) {
             // We need to cast towards the member type
-            const auto *dest_type = member_types.at(member_tuple.first);
+            const auto *dest_type = field.type;
             if (const auto *tb = dest_type->to<IR::Type_Bits>()) {
                 auto cast_val =
                     z3::int2bv(tb->size, *z3_var->get_val()).simplify();
@@ -269,6 +318,7 @@ HeaderInstance
 HeaderInstance::HeaderInstance(P4State *state, const IR::Type_Header *type,
                                cstring name, uint64_t member_id)
     : StructInstance(state, type, name, member_id) {
+    set_kind(P4Z3Kind::HeaderInstance);
     valid = state->get_z3_ctx()->bool_val(false);
     add_function("setValid0", [this](Visitor *visitor,
                                      const IR::Vector<IR::Argument> *args) {
@@ -312,11 +362,12 @@ z3::expr HeaderInstance::operator==(const P4Z3Instance &other) const {
     auto is_eq = state->get_z3_ctx()->bool_val(true);
     if (const auto *other_hdr = other.to<HeaderInstance>()) {
         auto other_is_valid = *other_hdr->get_valid();
-        for (auto member_tuple : members) {
-            auto member_name = member_tuple.first;
-            const auto *member_val = member_tuple.second;
-            const auto *other_val = other.get_member(member_name);
-            is_eq = is_eq && (member_val->operator==(*other_val));
+        bool same_layout = layout == other_hdr->layout;
+        for (size_t idx = 0; idx < members.size(); ++idx) {
+            const auto *other_val =
+                same_layout ? other_hdr->members[idx]
+                            : other.get_member(get_member_name(idx));
+            is_eq = is_eq && (members[idx]->operator==(*other_val));
         }
         auto both_invalid = !(valid || other_is_valid);
         auto both_valid_and_eq = (is_eq && valid && other_is_valid);
@@ -343,7 +394,7 @@ void HeaderInstance::setValid(Visitor * /*visitor*/,
                               const IR::Vector<IR::Argument> * /*args*/) {
     set_valid(state->get_z3_ctx()->bool_val(true));
     propagate_validity(&valid);
-    state->set_expr_result(new VoidResult());
+    state->set_expr_result(state->allocate<VoidResult>(state));
 }
 
 void HeaderInstance::setInvalid(Visitor * /*visitor*/,
@@ -351,12 +402,13 @@ void HeaderInstance::setInvalid(Visitor * /*visitor*/,
     valid = state->get_z3_ctx()->bool_val(false);
     propagate_validity(&valid);
     set_undefined();
-    state->set_expr_result(new VoidResult());
+    state->set_expr_result(state->allocate<VoidResult>(state));
 }
 
 void HeaderInstance::isValid(Visitor * /*visitor*/,
                              const IR::Vector<IR::Argument> * /*args*/) {
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, valid));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, valid));
 }
 
 void HeaderInstance::propagate_validity(const z3::expr *valid_expr) {
@@ -365,10 +417,12 @@ void HeaderInstance::propagate_validity(const z3::expr *valid_expr) {
     } else {
         cstring name = instance_name + "_valid";
         valid = state->get_z3_ctx()->bool_const(name);
+        if (instance_name.startsWith(UNDEF_LABEL)) {
+            state->record_undefined(valid);
+        }
         valid_expr = &valid;
     }
-    for (auto member_tuple : members) {
-        auto *member = member_tuple.second;
+    for (auto *member : members) {
         if (auto *z3_var = member->to_mut<StructBase>()) {
             z3_var->propagate_validity(valid_expr);
         }
@@ -376,7 +430,7 @@ void HeaderInstance::propagate_validity(const z3::expr *valid_expr) {
 }
 
 HeaderInstance *HeaderInstance::copy() const {
-    return new HeaderInstance(*this);
+    return state->allocate<HeaderInstance>(*this);
 }
 
 void HeaderInstance::merge(const z3::expr &cond, const P4Z3Instance &then_var) {
@@ -384,8 +438,10 @@ void HeaderInstance::merge(const z3::expr &cond, const P4Z3Instance &then_var) {
 
     BUG_CHECK(then_struct, "Unsupported merge class.");
     StructBase::merge(cond, then_var);
-    auto valid_merge = z3::ite(cond, *then_struct->get_valid(), valid);
-    set_valid(valid_merge);
+    const auto *then_valid = then_struct->get_valid();
+    if (!z3::eq(*then_valid, valid)) {
+        set_valid(z3::ite(cond, *then_valid, valid));
+    }
 }
 void HeaderInstance::set_list(std::vector<P4Z3Instance *> input_list) {
     StructBase::set_list(input_list);
@@ -409,6 +465,7 @@ StackInstance::StackInstance(P4State *state, const IR::Type_Stack *type,
       nextIndex(Z3Int(state, 0)), lastIndex(Z3Int(state, 0)),
       size(Z3Int(state, type->getSize())), int_size(type->getSize()),
       elem_type(state->resolve_type(type->elementType)) {
+    set_kind(P4Z3Kind::StackInstance);
     auto flat_id = member_id;
     for (size_t idx = 0; idx < int_size; ++idx) {
         auto *member_var = state->gen_instance(name, elem_type, flat_id);
@@ -420,8 +477,7 @@ StackInstance::StackInstance(P4State *state, const IR::Type_Stack *type,
                               member_var->get_static_type());
         }
         cstring member_name = std::to_string(idx);
-        insert_member(member_name, member_var);
-        member_types.insert({member_name, elem_type});
+        insert_member(member_name, member_var, elem_type);
     }
     add_function("push_front1", [this](Visitor *visitor,
                                        const IR::Vector<IR::Argument> *args) {
@@ -433,7 +489,9 @@ StackInstance::StackInstance(P4State *state, const IR::Type_Stack *type,
     });
 }
 
-StackInstance *StackInstance::copy() const { return new StackInstance(*this); }
+StackInstance *StackInstance::copy() const {
+    return state->allocate<StackInstance>(*this);
+}
 
 StackInstance::StackInstance(const StackInstance &other)
     : IndexableInstance(other), nextIndex(other.nextIndex),
@@ -488,7 +546,7 @@ void StackInstance::update_member(cstring name, P4Z3Instance *val) {
         name == "next") {
         return;
     }
-    members.at(name) = val;
+    StructBase::update_member(name, val);
 }
 
 P4Z3Instance *StackInstance::get_member(const z3::expr &index) const {
@@ -573,12 +631,12 @@ std::vector<std::pair<cstring, z3::expr>>
 StackInstance::get_z3_vars(cstring prefix, const z3::expr *valid_expr) const {
     // TODO: Clean this up and split it
     std::vector<std::pair<cstring, z3::expr>> z3_vars;
-    for (auto member_tuple : members) {
-        cstring name = member_tuple.first;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        cstring name = get_member_name(idx);
         if (prefix.size() != 0) {
             name = prefix + "." + name;
         }
-        const auto *member = member_tuple.second;
+        const auto *member = members[idx];
         if (const auto *z3_var = member->to<HeaderInstance>()) {
             auto z3_sub_vars = z3_var->get_z3_vars(name, valid_expr);
             z3_vars.insert(z3_vars.end(), z3_sub_vars.begin(),
@@ -604,6 +662,24 @@ HeaderUnionInstance::HeaderUnionInstance(P4State *state,
                                          const IR::Type_HeaderUnion *type,
                                          cstring name, uint64_t member_id)
     : StructBase(state, type, name, member_id) {
+    set_kind(P4Z3Kind::HeaderUnionInstance);
+    add_function("isValid0", [this](Visitor *visitor,
+                                    const IR::Vector<IR::Argument> *args) {
+        isValid(visitor, args);
+    });
+    if (auto type_layout = state->find_layout(type)) {
+        // The fields are already resolved, only generate the members.
+        layout = type_layout;
+        members.reserve(layout->size());
+        for (size_t idx = 0; idx < layout->size(); ++idx) {
+            const auto &field = layout->get_field(idx);
+            auto flat_id = member_id + field.offset;
+            members.push_back(state->gen_instance(
+                name + std::to_string(flat_id), field.type, flat_id));
+        }
+        width = layout->get_width();
+        return;
+    }
     auto flat_id = member_id;
     for (const auto *field : type->fields) {
         const IR::Type *resolved_type = state->resolve_type(field->type);
@@ -615,16 +691,12 @@ HeaderUnionInstance::HeaderUnionInstance(P4State *state,
                       member_var->to_string());
             width += si->get_width();
             flat_id += si->get_width();
-            insert_member(field->name.name, member_var);
-            member_types.insert({field->name.name, resolved_type});
+            insert_member(field->name.name, member_var, resolved_type);
         } else {
             P4C_UNIMPLEMENTED("Type \"%s\" not supported!", field->type);
         }
     }
-    add_function("isValid0", [this](Visitor *visitor,
-                                    const IR::Vector<IR::Argument> *args) {
-        isValid(visitor, args);
-    });
+    state->cache_layout(type, layout);
 }
 
 HeaderUnionInstance::HeaderUnionInstance(const HeaderUnionInstance &other)
@@ -655,12 +727,12 @@ HeaderUnionInstance::get_z3_vars(cstring prefix,
     std::vector<z3::expr> valid_vars;
 
     std::vector<std::pair<cstring, z3::expr>> z3_vars;
-    for (auto member_tuple : members) {
-        cstring name = member_tuple.first;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        cstring name = get_member_name(idx);
         if (prefix.size() != 0) {
             name = prefix + "." + name;
         }
-        const auto *member = member_tuple.second;
+        const auto *member = members[idx];
         if (const auto *hi = member->to<HeaderInstance>()) {
             auto z3_sub_vars = hi->get_z3_vars(name, valid_expr);
             z3_vars.insert(z3_vars.end(), z3_sub_vars.begin(),
@@ -674,9 +746,9 @@ HeaderUnionInstance::get_z3_vars(cstring prefix,
 z3::expr HeaderUnionInstance::get_valid() const {
     z3::expr valid_var = state->get_z3_ctx()->bool_val(false);
     // A header union is valid if any of its members is valid
-    for (const auto &member : members) {
-        const auto *hi = member.second->to<HeaderInstance>();
-        BUG_CHECK(hi, "Unexpected instance %s", member.second->to_string());
+    for (const auto *member : members) {
+        const auto *hi = member->to<HeaderInstance>();
+        BUG_CHECK(hi, "Unexpected instance %s", member->to_string());
         valid_var = valid_var || *hi->get_valid();
     }
     return valid_var;
@@ -684,18 +756,29 @@ z3::expr HeaderUnionInstance::get_valid() const {
 
 void HeaderUnionInstance::isValid(Visitor * /*visitor*/,
                                   const IR::Vector<IR::Argument> * /*args*/) {
-    state->set_expr_result(new Z3Bitvector(state, &BOOL_TYPE, get_valid()));
+    state->set_expr_result(
+        state->allocate<Z3Bitvector>(state, &BOOL_TYPE, get_valid()));
 }
 
 HeaderUnionInstance *HeaderUnionInstance::copy() const {
-    return new HeaderUnionInstance(*this);
+    return state->allocate<HeaderUnionInstance>(*this);
+}
+
+void HeaderUnionInstance::rename(cstring name, uint64_t member_id) {
+    instance_name = name;
+    for (size_t idx = 0; idx < members.size(); ++idx) {
+        auto flat_id = member_id + layout->get_field(idx).offset;
+        auto *hi = members[idx]->to_mut<HeaderInstance>();
+        BUG_CHECK(hi, "Unexpected instance %s", members[idx]->to_string());
+        hi->rename(name + std::to_string(flat_id), flat_id);
+    }
 }
 
 void HeaderUnionInstance::update_validity(const HeaderInstance * /*child*/,
                                           const z3::expr &valid_val) {
-    for (auto &member : members) {
-        auto *hi = member.second->to_mut<HeaderInstance>();
-        BUG_CHECK(hi, "Unexpected instance %s", member.second->to_string());
+    for (auto *member : members) {
+        auto *hi = member->to_mut<HeaderInstance>();
+        BUG_CHECK(hi, "Unexpected instance %s", member->to_string());
         const auto *old_valid = hi->get_valid();
         // This is kind of stupid but works,
         // I have no means to check child equality yet
@@ -714,7 +797,9 @@ EnumBase
 EnumBase::EnumBase(P4State *state, const IR::Type *type, cstring name,
                    uint64_t member_id)
     : StructBase(state, type, name, member_id),
-      ValContainer(state->gen_z3_expr(UNDEF_LABEL, &P4_STD_BIT_TYPE)) {}
+      ValContainer(state->gen_z3_expr(UNDEF_LABEL, &P4_STD_BIT_TYPE)) {
+    set_kind(P4Z3Kind::EnumBase);
+}
 
 std::vector<std::pair<cstring, z3::expr>>
 EnumBase::get_z3_vars(cstring prefix, const z3::expr *valid_expr) const {
@@ -736,13 +821,22 @@ EnumBase::get_z3_vars(cstring prefix, const z3::expr *valid_expr) const {
 }
 
 void EnumBase::add_enum_member(cstring error_name) {
-    insert_member(error_name, new Z3Bitvector(state, member_type, val));
+    insert_member(error_name,
+                  state->allocate<Z3Bitvector>(state, member_type, val),
+                  member_type);
+    // Prototypes hold copies of the declaration without the new member.
+    state->clear_prototypes();
 }
 
 void EnumBase::set_undefined() {
     val = state->gen_z3_expr(UNDEF_LABEL, member_type);
 }
 
+void EnumBase::rename(cstring name, uint64_t /*member_id*/) {
+    // Like gen_instance, only the value is named, not the declaration copy.
+    val = state->gen_z3_expr(name, member_type);
+}
+
 void EnumBase::bind(const z3::expr *bind_var, uint64_t offset) {
     if (bind_var != nullptr) {
         auto var_width = get_width();
@@ -783,7 +877,9 @@ void EnumBase::set_enum_val(const z3::expr &enum_input) { val = enum_input; }
 void EnumBase::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     const auto *then_enum = then_expr.to<EnumBase>();
     BUG_CHECK(then_enum, "Unsupported merge class.");
-    val = z3::ite(cond, *then_enum->get_val(), val);
+    if (!z3::eq(*then_enum->get_val(), val)) {
+        val = z3::ite(cond, *then_enum->get_val(), val);
+    }
 }
 
 EnumBase::EnumBase(const EnumBase &other)
@@ -799,22 +895,24 @@ EnumInstance
 EnumInstance::EnumInstance(P4State *p4_state, const IR::Type_Enum *type,
                            cstring name, uint64_t member_id)
     : EnumBase(p4_state, type, name, member_id) {
+    set_kind(P4Z3Kind::EnumInstance);
     // FIXME: Enums should not be a struct base, actually
     width = 32;
     size_t idx = 0;
     for (const auto *member : type->members) {
-        auto *member_var = new Z3Bitvector(
+        auto *member_var = state->allocate<Z3Bitvector>(
             state, member_type, state->get_z3_ctx()->bv_val(idx, 32));
-        insert_member(member->name.name, member_var);
-        member_types.insert({member->name.name, member_type});
+        insert_member(member->name.name, member_var, member_type);
         idx++;
     }
 }
 
-EnumInstance *EnumInstance::copy() const { return new EnumInstance(*this); }
+EnumInstance *EnumInstance::copy() const {
+    return state->allocate<EnumInstance>(*this);
+}
 
 EnumInstance *EnumInstance::instantiate(const NumericVal &enum_val) const {
-    auto *enum_copy = new EnumInstance(*this);
+    auto *enum_copy = state->allocate<EnumInstance>(*this);
     auto current_sort = val.get_sort();
     enum_copy->set_enum_val(pure_bv_cast(*enum_val.get_val(), current_sort));
     return enum_copy;
@@ -839,22 +937,24 @@ ErrorInstance
 ErrorInstance::ErrorInstance(P4State *p4_state, const IR::Type_Error *type,
                              cstring name, uint64_t member_id)
     : EnumBase(p4_state, type, name, member_id) {
+    set_kind(P4Z3Kind::ErrorInstance);
     // FIXME: Enums should not be a struct base, actually
     width = 32;
     size_t idx = 0;
     for (const auto *member : type->members) {
-        auto *member_var = new Z3Bitvector(
+        auto *member_var = state->allocate<Z3Bitvector>(
             state, member_type, state->get_z3_ctx()->bv_val(idx, 32));
-        insert_member(member->name.name, member_var);
-        member_types.insert({member->name.name, member_type});
+        insert_member(member->name.name, member_var, member_type);
         idx++;
     }
 }
 
-ErrorInstance *ErrorInstance::copy() const { return new ErrorInstance(*this); }
+ErrorInstance *ErrorInstance::copy() const {
+    return state->allocate<ErrorInstance>(*this);
+}
 
 ErrorInstance *ErrorInstance::instantiate(const NumericVal &enum_val) const {
-    auto *enum_copy = new ErrorInstance(*this);
+    auto *enum_copy = state->allocate<ErrorInstance>(*this);
     auto current_sort = val.get_sort();
     enum_copy->set_enum_val(pure_bv_cast(*enum_val.get_val(), current_sort));
     return enum_copy;
@@ -871,8 +971,12 @@ SerEnumInstance::SerEnumInstance(
     const ordered_map<cstring, P4Z3Instance *> &input_members,
     const IR::Type_SerEnum *type, cstring name, uint64_t member_id)
     : EnumBase(p4_state, type, name, member_id) {
-    members.clear();
-    members.insert(input_members.begin(), input_members.end());
+    set_kind(P4Z3Kind::SerEnumInstance);
+    for (const auto &input_member : input_members) {
+        auto *member_val = input_member.second;
+        insert_member(input_member.first, member_val,
+                      member_val->get_p4_type());
+    }
     const auto *resolved_type = state->resolve_type(type->type);
     val = state->gen_z3_expr(UNDEF_LABEL, resolved_type);
     if (const auto *tb = resolved_type->to<IR::Type_Bits>()) {
@@ -885,12 +989,12 @@ SerEnumInstance::SerEnumInstance(
 }
 
 SerEnumInstance *SerEnumInstance::copy() const {
-    return new SerEnumInstance(*this);
+    return state->allocate<SerEnumInstance>(*this);
 }
 
 SerEnumInstance *
 SerEnumInstance::instantiate(const NumericVal &enum_val) const {
-    auto *enum_copy = new SerEnumInstance(*this);
+    auto *enum_copy = state->allocate<SerEnumInstance>(*this);
     auto current_sort = val.get_sort();
     enum_copy->set_enum_val(pure_bv_cast(*enum_val.get_val(), current_sort));
     return enum_copy;
@@ -917,6 +1021,7 @@ ExternInstance
 
 ExternInstance::ExternInstance(P4State *state, const IR::Type_Extern *p4_type)
     : P4Z3Instance(p4_type), state(state), extern_type(p4_type) {
+    set_kind(P4Z3Kind::ExternInstance);
     for (const auto *method : p4_type->methods) {
         // FIXME: Overloading uses num of parameters, it should use types
         cstring overloaded_name = method->name.name;
@@ -938,6 +1043,10 @@ ExternInstance::ExternInstance(P4State *state, const IR::Type_Extern *p4_type)
     }
 }
 
+ExternInstance *ExternInstance::copy() const {
+    return state->allocate<ExternInstance>(state, extern_type);
+}
+
 P4Z3Instance *ExternInstance::cast_allocate(const IR::Type *dest_type) const {
     // There is only rudimentary casting support, just copy for now
     // TODO: Make this proper and think about equality here...
@@ -955,13 +1064,13 @@ ListInstance::ListInstance(P4State *state,
                            const std::vector<P4Z3Instance *> &val_list,
                            const IR::Type *type_list)
     : StructBase(state, type_list, "", 0) {
+    set_kind(P4Z3Kind::ListInstance);
     IR::Vector<IR::Type> components;
     for (size_t idx = 0; idx < val_list.size(); ++idx) {
         auto *val = val_list[idx];
         cstring name = std::to_string(idx);
-        insert_member(name, val);
         const auto *type = val->get_p4_type();
-        member_types.insert({name, type});
+        insert_member(name, val, type);
         components.push_back(type);
     }
     // The list should have the type information now
@@ -971,12 +1080,12 @@ ListInstance::ListInstance(P4State *state,
 ListInstance::ListInstance(P4State *state, const IR::Type_List *list_type,
                            cstring name, uint64_t member_id)
     : StructBase(state, list_type, name, member_id) {
+    set_kind(P4Z3Kind::ListInstance);
     auto flat_id = member_id;
     for (size_t idx = 0; idx < list_type->components.size(); ++idx) {
         const auto *type = list_type->components[idx];
         cstring name = std::to_string(idx);
-        insert_member(name, state->gen_instance(name, type));
-        member_types.insert({name, type});
+        insert_member(name, state->gen_instance(name, type), type);
         flat_id++;
     }
 }
@@ -996,21 +1105,18 @@ P4Z3Instance *ListInstance::cast_allocate(const IR::Type *dest_type) const {
 }
 
 ListInstance *ListInstance::copy() const {
-    return new ListInstance(state, get_val_list(), p4_type);
+    return state->allocate<ListInstance>(state, get_val_list(), p4_type);
 }
 
 std::vector<P4Z3Instance *> ListInstance::get_val_list() const {
     std::vector<P4Z3Instance *> val_list;
-    for (const auto &member : members) {
-        val_list.push_back(member.second);
-    }
+    val_list.insert(val_list.end(), members.begin(), members.end());
     return val_list;
 }
 
 void unroll_list(const StructBase *input_struct,
                  std::vector<P4Z3Instance *> *target_list) {
-    for (const auto &member : *input_struct->get_member_map()) {
-        auto *member_instance = member.second;
+    for (auto *member_instance : input_struct->get_members()) {
         if (const auto *sb = member_instance->to<StructBase>()) {
             unroll_list(sb, target_list);
         } else {
@@ -1042,7 +1148,7 @@ z3::expr ListInstance::operator==(const P4Z3Instance &other) const {
             return state->get_z3_ctx()->bool_val(false);
         }
         // Compare the first element in the list
-        return *members.begin()->second == other;
+        return *members.front() == other;
     }
     P4C_UNIMPLEMENTED("Comparing a ListInstance to %s is not supported.",
                       other.get_static_type());
@@ -1061,19 +1167,21 @@ TupleInstance
 TupleInstance::TupleInstance(P4State *state, const IR::Type_Tuple *type,
                              cstring name, uint64_t member_id)
     : IndexableInstance(state, type, name, member_id) {
+    set_kind(P4Z3Kind::TupleInstance);
     size_t idx = 0;
     for (const auto &field_type : type->components) {
         const IR::Type *resolved_type = state->resolve_type(field_type);
         auto *member_var =
             state->gen_instance(name, resolved_type, member_id + idx);
         cstring name = std::to_string(idx);
-        insert_member(name, member_var);
-        member_types.insert({name, resolved_type});
+        insert_member(name, member_var, resolved_type);
         idx++;
     }
 }
 
-TupleInstance *TupleInstance::copy() const { return new TupleInstance(*this); }
+TupleInstance *TupleInstance::copy() const {
+    return state->allocate<TupleInstance>(*this);
+}
 
 P4Z3Instance *TupleInstance::get_member(const z3::expr &index) const {
     auto val = index.simplify();
@@ -1094,6 +1202,7 @@ ControlInstance
 ControlInstance::ControlInstance(P4State *state, const IR::Type *decl,
                                  const VarMap &input_const_args)
     : P4Z3Instance(decl), state(state) {
+    set_kind(P4Z3Kind::ControlInstance);
     resolved_const_args.insert(input_const_args.begin(),
                                input_const_args.end());
     const IR::ParameterList *params = nullptr;
@@ -1172,8 +1281,9 @@ void ControlInstance::apply(Visitor *visitor,
     }
     if (!parser_states.empty()) {
         for (const auto &parser_state : parser_states) {
-            state->declare_static_decl(parser_state->name.name,
-                                       new P4Declaration(parser_state));
+            auto *state_decl =
+                state->allocate<P4Declaration>(state, parser_state);
+            state->declare_static_decl(parser_state->name.name, state_decl);
         }
         visitor->visit(state->get_static_decl("start")->get_decl());
     }
@@ -1206,6 +1316,11 @@ get_type_mapping(const IR::ParameterList *src_params,
     return type_mapping;
 }
 
+ControlInstance *ControlInstance::copy() const {
+    return state->allocate<ControlInstance>(state, p4_type,
+                                            resolved_const_args);
+}
+
 P4Z3Instance *ControlInstance::cast_allocate(const IR::Type *dest_type) const {
     // There is only rudimentary casting support, just copy for now
     // TODO: Make this proper and think about equality here...
@@ -1219,7 +1334,8 @@ P4Z3Instance *ControlInstance::cast_allocate(const IR::Type *dest_type) const {
             TypeModifier type_modifier(&type_mapping);
             const auto *cast_type =
                 p4_type->clone()->apply(type_modifier)->checkedTo<IR::Type>();
-            return new ControlInstance(state, cast_type, resolved_const_args);
+            return state->allocate<ControlInstance>(state, cast_type,
+                                                    resolved_const_args);
         }
     }
     if (const auto *parser = p4_type->to<IR::P4Parser>()) {
@@ -1232,11 +1348,16 @@ P4Z3Instance *ControlInstance::cast_allocate(const IR::Type *dest_type) const {
             TypeModifier type_modifier(&type_mapping);
             const auto *cast_type =
                 p4_type->clone()->apply(type_modifier)->checkedTo<IR::Type>();
-            return new ControlInstance(state, cast_type, resolved_const_args);
+            return state->allocate<ControlInstance>(state, cast_type,
+                                                    resolved_const_args);
         }
     }
     P4C_UNIMPLEMENTED("Unsupported cast from type %s to type %s for %s",
                       p4_type, dest_type, get_static_type());
 }
 
+P4Declaration *P4Declaration::copy() const {
+    return state->allocate<P4Declaration>(state, decl);
+}
+
 }  // namespace TOZ3
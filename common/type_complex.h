@@ -3,6 +3,7 @@
 #include <cstdio>
 
 #include <map>      // std::map
+#include <memory>   // std::shared_ptr
 #include <string>   // std::to_string
 #include <utility>  // std::pair
 #include <vector>   // std::vector
@@ -11,6 +12,7 @@
 #include "ir/ir.h"
 #include "lib/cstring.h"
 
+#include "type_layout.h"
 #include "type_simple.h"
 
 namespace TOZ3 {
@@ -35,12 +37,18 @@ class FunctionClass {
 class StructBase : public P4Z3Instance {
  protected:
     P4State *state;
-    ordered_map<cstring, P4Z3Instance *> members;
-    std::map<cstring, const IR::Type *> member_types;
+    // Shared by instances of the same type, copied before it is extended.
+    std::shared_ptr<StructLayout> layout;
+    // Indexed by the field number of the layout.
+    std::vector<P4Z3Instance *> members;
     uint64_t width;
     z3::expr valid;
     cstring instance_name;
 
+    size_t find_member(cstring name) const {
+        return layout == nullptr ? members.size() : layout->find_field(name);
+    }
+
  public:
     StructBase(P4State *state, const IR::Type *type, cstring name,
                uint64_t member_id);
@@ -48,41 +56,43 @@ class StructBase : public P4Z3Instance {
     uint64_t get_width() const { return width; }
 
     const P4Z3Instance *get_const_member(const cstring name) const {
-        auto it = members.find(name);
-        if (it != members.end()) {
-            return it->second;
-        }
-        BUG("Name %s not found in member map.", name);
+        return StructBase::get_member(name);
     }
     P4Z3Instance *get_member(const cstring name) const override {
-        auto it = members.find(name);
-        if (it != members.end()) {
-            return it->second;
+        auto idx = find_member(name);
+        if (idx < members.size()) {
+            return members[idx];
         }
         BUG("Name %s not found in member map.", name);
     }
     virtual const IR::Type *get_member_type(cstring name) const {
-        auto it = member_types.find(name);
-        if (it != member_types.end()) {
-            return it->second;
+        auto idx = find_member(name);
+        if (idx < members.size()) {
+            return layout->get_field(idx).type;
         }
         BUG("Name %s not found in member type map of %s.", name,
             get_static_type());
     }
 
     virtual void update_member(cstring name, P4Z3Instance *val) {
-        members.at(name) = val;
-    }
-    void insert_member(cstring name, P4Z3Instance *val) {
-        members.emplace(name, val);
+        auto idx = find_member(name);
+        if (idx < members.size()) {
+            members[idx] = val;
+            return;
+        }
+        BUG("Name %s not found in member map.", name);
     }
-    const ordered_map<cstring, P4Z3Instance *> *get_member_map() const {
-        return &members;
+    void insert_member(cstring name, P4Z3Instance *val, const IR::Type *type);
+    const std::vector<P4Z3Instance *> &get_members() const { return members; }
+    cstring get_member_name(size_t idx) const {
+        return layout->get_field(idx).name;
     }
     void set_undefined() override;
     virtual void propagate_validity(const z3::expr *valid_expr = nullptr);
     virtual void bind(const z3::expr *bind_var = nullptr, uint64_t offset = 0);
     virtual void set_list(std::vector<P4Z3Instance *>);
+    // Names a fresh copy as if gen_instance had generated it with this name.
+    virtual void rename(cstring name, uint64_t member_id);
 
     // copy constructor
     StructBase(const StructBase &other);
@@ -108,11 +118,11 @@ class StructInstance : public StructBase {
     cstring to_string() const override {
         cstring ret = "StructInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -151,11 +161,11 @@ class HeaderInstance : public StructInstance, public FunctionClass {
         cstring ret = "HeaderInstance(";
         ret += "valid: " + valid.to_string() + ", ";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -201,11 +211,11 @@ class StackInstance : public IndexableInstance, public FunctionClass {
     cstring to_string() const override {
         cstring ret = "StackInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -254,11 +264,11 @@ class HeaderUnionInstance : public StructBase, public FunctionClass {
     cstring to_string() const override {
         cstring ret = "HeaderUnionInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -266,6 +276,7 @@ class HeaderUnionInstance : public StructBase, public FunctionClass {
     }
     void update_validity(const HeaderInstance *child,
                          const z3::expr &valid_val);
+    void rename(cstring name, uint64_t member_id) override;
     void isValid(Visitor *visitor, const IR::Vector<IR::Argument> *args);
     HeaderUnionInstance *copy() const override;
     // copy constructor
@@ -290,11 +301,11 @@ class EnumBase : public StructBase, public ValContainer {
     cstring to_string() const override {
         cstring ret = "EnumBase(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -303,6 +314,7 @@ class EnumBase : public StructBase, public ValContainer {
     void set_undefined() override;
     void add_enum_member(cstring error_name);
     void bind(const z3::expr *bind_var = nullptr, uint64_t offset = 0) override;
+    void rename(cstring name, uint64_t member_id) override;
     void merge(const z3::expr &cond, const P4Z3Instance &then_expr) override;
     z3::expr operator==(const P4Z3Instance &other) const override;
     z3::expr operator!=(const P4Z3Instance &other) const override;
@@ -323,11 +335,11 @@ class EnumInstance : public EnumBase {
     cstring to_string() const override {
         cstring ret = "EnumInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -351,11 +363,11 @@ class ErrorInstance : public EnumBase {
     cstring to_string() const override {
         cstring ret = "ErrorInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -374,11 +386,11 @@ class SerEnumInstance : public EnumBase {
     cstring to_string() const override {
         cstring ret = "SerSerEnumInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -402,11 +414,11 @@ class ListInstance : public StructBase {
     cstring to_string() const override {
         cstring ret = "ListInstance(";
         bool first = true;
-        for (auto tuple : members) {
+        for (size_t idx = 0; idx < members.size(); ++idx) {
             if (!first) {
                 ret += ", ";
             }
-            ret += tuple.first + ": " + tuple.second->to_string();
+            ret += get_member_name(idx) + ": " + members[idx]->to_string();
             first = false;
         }
         ret += ")";
@@ -432,9 +444,7 @@ class ControlInstance : public P4Z3Instance, public FunctionClass {
     // Merge is a no-op here.
     void merge(const z3::expr & /*cond*/,
                const P4Z3Instance & /*then_expr*/) override{};
-    ControlInstance *copy() const override {
-        return new ControlInstance(state, p4_type, resolved_const_args);
-    }
+    ControlInstance *copy() const override;
 
     void apply(Visitor *, const IR::Vector<IR::Argument> *);
 
@@ -448,19 +458,24 @@ class ControlInstance : public P4Z3Instance, public FunctionClass {
 
 class P4Declaration : public P4Z3Instance {
     // A wrapper class for declarations
+ protected:
+    P4State *state;
+
  private:
     const IR::StatOrDecl *decl;
 
  public:
     // constructor
     // TODO: This is a declaration, not an object. Distinguish!
-    explicit P4Declaration(const IR::StatOrDecl *decl)
-        : P4Z3Instance(nullptr), decl(decl) {}
+    explicit P4Declaration(P4State *state, const IR::StatOrDecl *decl)
+        : P4Z3Instance(nullptr), state(state), decl(decl) {
+        set_kind(P4Z3Kind::P4Declaration);
+    }
     // Merge is a no-op here.
     void merge(const z3::expr & /*cond*/,
                const P4Z3Instance & /*then_expr*/) override{};
     // TODO: This is a little pointless....
-    P4Declaration *copy() const override { return new P4Declaration(decl); }
+    P4Declaration *copy() const override;
 
     cstring get_static_type() const override { return "P4Declaration"; }
     cstring to_string() const override {
@@ -473,7 +488,6 @@ class P4Declaration : public P4Z3Instance {
 class P4TableInstance : public P4Declaration, public FunctionClass {
     // A wrapper class for table declarations
  private:
-    P4State *state;
     ordered_map<cstring, P4Z3Instance *> members;
 
  public:
@@ -487,9 +501,7 @@ class P4TableInstance : public P4Declaration, public FunctionClass {
     void merge(const z3::expr & /*cond*/,
                const P4Z3Instance & /*then_expr*/) override {}
 
-    P4TableInstance *copy() const override {
-        return new P4TableInstance(state, get_decl(), hit, table_props);
-    }
+    P4TableInstance *copy() const override;
 
     P4Z3Instance *get_member(cstring name) const override {
         auto it = members.find(name);
@@ -536,9 +548,7 @@ class ExternInstance : public P4Z3Instance, public FunctionClass {
         return FunctionClass::get_function(name);
     }
     // TODO: This is a little pointless....
-    ExternInstance *copy() const override {
-        return new ExternInstance(state, extern_type);
-    }
+    ExternInstance *copy() const override;
     P4Z3Instance *cast_allocate(const IR::Type *dest_type) const override;
 };
 
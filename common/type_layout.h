@@ -0,0 +1,58 @@
+#ifndef TOZ3_COMMON_TYPE_LAYOUT_H_
+#define TOZ3_COMMON_TYPE_LAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>  // std::vector
+
+#include "ir/ir.h"
+#include "lib/cstring.h"
+
+#include "name_map.h"
+
+namespace TOZ3 {
+
+struct FieldLayout {
+    cstring name;
+    const IR::Type *type;
+    // Bits between the most significant bit of the instance and the field.
+    uint64_t offset;
+    uint64_t width;
+    bool is_signed;
+};
+
+// The fields of a struct-like instance in declaration order. Instances of the
+// same type share a layout and keep their members in a vector indexed by the
+// field number.
+class StructLayout {
+ private:
+    std::vector<FieldLayout> fields;
+    NameMap<size_t> field_ids;
+    uint64_t width = 0;
+
+ public:
+    // Returns the number of the new field, or of the field with this name.
+    size_t add_field(cstring name, const IR::Type *type, uint64_t field_width,
+                     bool is_signed) {
+        auto result = field_ids.insert({name, fields.size()});
+        if (!result.second) {
+            return result.first->second;
+        }
+        fields.push_back({name, type, width, field_width, is_signed});
+        width += field_width;
+        return fields.size() - 1;
+    }
+    // Returns size() if there is no field with this name.
+    size_t find_field(cstring name) const {
+        auto it = field_ids.find(name);
+        return it != field_ids.end() ? it->second : fields.size();
+    }
+    const FieldLayout &get_field(size_t idx) const { return fields[idx]; }
+    size_t size() const { return fields.size(); }
+    uint64_t get_width() const { return width; }
+};
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_COMMON_TYPE_LAYOUT_H_
@@ -7,6 +7,20 @@
 
 namespace TOZ3 {
 
+void NumericVal::set_undefined() {
+    auto sort = val.get_sort();
+    val = state->get_z3_ctx()->constant(UNDEF_LABEL, sort);
+    state->record_undefined(val);
+}
+
+VoidResult *VoidResult::copy() const {
+    return state->allocate<VoidResult>(state);
+}
+
+P4Z3Instance *VoidResult::cast_allocate(const IR::Type * /*dest_type*/) const {
+    return state->allocate<VoidResult>(state);
+}
+
 z3::expr pure_bv_cast(const z3::expr &expr, const z3::sort &dest_type) {
     // TODO: Clean this up.
     uint64_t expr_size = 0;
@@ -66,6 +80,7 @@ Z3Bitvector
 Z3Bitvector::Z3Bitvector(const P4State *state, const IR::Type *p4_type,
                          const z3::expr &val, bool is_signed)
     : NumericVal(state, p4_type, val), is_signed(is_signed) {
+    set_kind(P4Z3Kind::Z3Bitvector);
     if (p4_type->is<IR::Type_Bits>()) {
         width = p4_type->width_bits();
     } else if (const auto *tvb = p4_type->to<IR::Type_Varbits>()) {
@@ -83,42 +98,45 @@ Z3Bitvector::Z3Bitvector(const P4State *state, const IR::Type *p4_type,
 /****** UNARY OPERANDS ******/
 
 P4Z3Instance *Z3Bitvector::operator-() const {
-    return new Z3Bitvector(state, p4_type, -val, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, -val, is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator~() const {
-    return new Z3Bitvector(state, p4_type, ~val, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, ~val, is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator!() const {
-    return new Z3Bitvector(state, p4_type, !val, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, !val, is_signed);
 }
 
 /****** BINARY OPERANDS ******/
 
 P4Z3Instance *Z3Bitvector::operator*(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "*");
-    return new Z3Bitvector(state, p4_type, val * other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val * other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator/(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "/");
     if (is_signed) {
-        return new Z3Bitvector(state, p4_type, val / other_expr, is_signed);
+        return state->allocate<Z3Bitvector>(state, p4_type, val / other_expr,
+                                            is_signed);
     }
-    return new Z3Bitvector(state, p4_type, z3::udiv(val, other_expr),
-                           is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type,
+                                        z3::udiv(val, other_expr), is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator%(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "%");
-    return new Z3Bitvector(state, p4_type, z3::urem(val, other_expr),
-                           is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type,
+                                        z3::urem(val, other_expr), is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator+(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "+");
-    return new Z3Bitvector(state, p4_type, val + other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val + other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operatorAddSat(const P4Z3Instance &other) const {
@@ -129,7 +147,7 @@ P4Z3Instance *Z3Bitvector::operatorAddSat(const P4Z3Instance &other) const {
     auto *ctx = &sort.ctx();
     auto big_str = get_max_bv_val(sort.bv_size());
     z3::expr max_val = ctx->bv_val(big_str.c_str(), sort.bv_size());
-    return new Z3Bitvector(
+    return state->allocate<Z3Bitvector>(
         state, p4_type,
         z3::ite(no_underflow && no_overflow, val + other_expr, max_val),
         is_signed);
@@ -137,7 +155,8 @@ P4Z3Instance *Z3Bitvector::operatorAddSat(const P4Z3Instance &other) const {
 
 P4Z3Instance *Z3Bitvector::operator-(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "!=");
-    return new Z3Bitvector(state, p4_type, val - other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val - other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operatorSubSat(const P4Z3Instance &other) const {
@@ -147,7 +166,7 @@ P4Z3Instance *Z3Bitvector::operatorSubSat(const P4Z3Instance &other) const {
     auto sort = val.get_sort();
     auto *ctx = &sort.ctx();
     z3::expr min_val = ctx->bv_val(0, sort.bv_size());
-    return new Z3Bitvector(
+    return state->allocate<Z3Bitvector>(
         state, p4_type,
         z3::ite(no_underflow && no_overflow, val - other_expr, min_val),
         is_signed);
@@ -178,12 +197,13 @@ P4Z3Instance *Z3Bitvector::operator>>(const P4Z3Instance &other) const {
     }
     if (is_signed) {
         auto shift_result = z3::ashr(*cast_this, *cast_other);
-        return new Z3Bitvector(
+        return state->allocate<Z3Bitvector>(
             state, p4_type, pure_bv_cast(shift_result, this_sort), is_signed);
     }
     auto shift_result = z3::lshr(*cast_this, *cast_other);
-    return new Z3Bitvector(state, p4_type,
-                           pure_bv_cast(shift_result, this_sort), is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type,
+                                        pure_bv_cast(shift_result, this_sort),
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator<<(const P4Z3Instance &other) const {
@@ -195,7 +215,8 @@ P4Z3Instance *Z3Bitvector::operator<<(const P4Z3Instance &other) const {
         // TODO: Check big int here
         if (target_int->get_val()->get_numeral_int64() > this_sort.bv_size()) {
             auto bv_val = this_sort.ctx().bv_val(0, this_sort.bv_size());
-            return new Z3Bitvector(state, p4_type, bv_val, is_signed);
+            return state->allocate<Z3Bitvector>(state, p4_type, bv_val,
+                                                is_signed);
         }
         auto cast_val = pure_bv_cast(*target_int->get_val(), this_sort);
         cast_other = &cast_val;
@@ -217,8 +238,9 @@ P4Z3Instance *Z3Bitvector::operator<<(const P4Z3Instance &other) const {
     }
     auto shift_result = z3::shl(*cast_this, *cast_other).simplify();
 
-    return new Z3Bitvector(state, p4_type,
-                           pure_bv_cast(shift_result, this_sort), is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type,
+                                        pure_bv_cast(shift_result, this_sort),
+                                        is_signed);
 }
 
 z3::expr Z3Bitvector::operator==(const P4Z3Instance &other) const {
@@ -280,17 +302,20 @@ z3::expr Z3Bitvector::operator||(const P4Z3Instance &other) const {
 
 P4Z3Instance *Z3Bitvector::operator&(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "&");
-    return new Z3Bitvector(state, p4_type, val & other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val & other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator|(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "|");
-    return new Z3Bitvector(state, p4_type, val | other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val | other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::operator^(const P4Z3Instance &other) const {
     auto other_expr = align_bitvectors(&other, val.get_sort(), false, "^");
-    return new Z3Bitvector(state, p4_type, val ^ other_expr, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val ^ other_expr,
+                                        is_signed);
 }
 
 P4Z3Instance *Z3Bitvector::concat(const P4Z3Instance &other) const {
@@ -300,8 +325,9 @@ P4Z3Instance *Z3Bitvector::concat(const P4Z3Instance &other) const {
         const auto *concat_type = new IR::Type_Bits(
             other_expr->get_sort().bv_size() + val.get_sort().bv_size(), false);
 
-        return new Z3Bitvector(state, concat_type, z3::concat(val, *other_expr),
-                               is_signed);
+        return state->allocate<Z3Bitvector>(state, concat_type,
+                                            z3::concat(val, *other_expr),
+                                            is_signed);
     }
     P4C_UNIMPLEMENTED("concat not implemented for %s.",
                       other.get_static_type());
@@ -318,31 +344,33 @@ P4Z3Instance *Z3Bitvector::cast_allocate(const IR::Type *dest_type) const {
     if (const auto *tb = dest_type->to<IR::Type_Bits>()) {
         auto *ctx = &val.get_sort().ctx();
         auto dest_sort = ctx->bv_sort(tb->size);
-        return new Z3Bitvector(state, dest_type, pure_bv_cast(val, dest_sort));
+        return state->allocate<Z3Bitvector>(state, dest_type,
+                                            pure_bv_cast(val, dest_sort));
     }
     // TODO: Merge with Bits
     if (const auto *tvb = dest_type->to<IR::Type_Varbits>()) {
         auto *ctx = &val.get_sort().ctx();
         auto dest_sort = ctx->bv_sort(tvb->size);
-        return new Z3Bitvector(state, dest_type, pure_bv_cast(val, dest_sort));
+        return state->allocate<Z3Bitvector>(state, dest_type,
+                                            pure_bv_cast(val, dest_sort));
     }
     if (dest_type->is<IR::Type_InfInt>()) {
         // TODO: Clean this up and add some checks
         auto *ctx = &val.get_sort().ctx();
         auto dec_str = val.get_decimal_string(0);
         auto int_expr = ctx->int_val(dec_str.c_str());
-        return new Z3Int(state, int_expr);
+        return state->allocate<Z3Int>(state, int_expr);
     }
     if (dest_type->is<IR::Type_Boolean>()) {
         auto *ctx = &val.get_sort().ctx();
         auto dest_sort = ctx->bool_sort();
         if (val.is_bool()) {
             // nothing to do just return a new object
-            return new Z3Bitvector(state, &BOOL_TYPE, val);
+            return state->allocate<Z3Bitvector>(state, &BOOL_TYPE, val);
         }
         if (val.is_bv()) {
             z3::expr bool_res = val > 0;
-            return new Z3Bitvector(state, &BOOL_TYPE, val > 0);
+            return state->allocate<Z3Bitvector>(state, &BOOL_TYPE, val > 0);
         }
     }
     if (const auto *te = dest_type->to<IR::Type_Enum>()) {
@@ -367,17 +395,19 @@ P4Z3Instance *Z3Bitvector::slice(const z3::expr &hi, const z3::expr &lo) const {
     auto hi_int = hi.simplify().get_numeral_int();
     auto lo_int = lo.simplify().get_numeral_int();
     const auto *slice_type = new IR::Type_Bits(hi_int - lo_int + 1, false);
-    return new Z3Bitvector(state, slice_type,
-                           val.extract(hi_int, lo_int).simplify(), is_signed);
+    return state->allocate<Z3Bitvector>(state, slice_type,
+                                        val.extract(hi_int, lo_int).simplify(),
+                                        is_signed);
 }
 
 Z3Bitvector *Z3Bitvector::copy() const {
-    return new Z3Bitvector(state, p4_type, val, is_signed);
+    return state->allocate<Z3Bitvector>(state, p4_type, val, is_signed);
 }
 
 void Z3Bitvector::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     if (const auto *then_expr_var = then_expr.to<Z3Bitvector>()) {
-        if (cond.is_false()) {
+        // Identical expressions do not need an ite node.
+        if (cond.is_false() || z3::eq(then_expr_var->val, val)) {
             val = val;
         } else if (cond.is_true()) {
             val = then_expr_var->val;
@@ -387,7 +417,7 @@ void Z3Bitvector::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     } else if (const auto *then_expr_var = then_expr.to<Z3Int>()) {
         z3::expr cast_val =
             pure_bv_cast(*then_expr_var->get_val(), val.get_sort());
-        if (cond.is_false()) {
+        if (cond.is_false() || z3::eq(cast_val, val)) {
             val = val;
         } else if (cond.is_true()) {
             val = cast_val;
@@ -408,23 +438,33 @@ Z3Int
 ***/
 
 Z3Int::Z3Int(const P4State *state, const z3::expr &val)
-    : NumericVal(state, &INT_TYPE, val) {}
+    : NumericVal(state, &INT_TYPE, val) {
+    set_kind(P4Z3Kind::Z3Int);
+}
 Z3Int::Z3Int(const P4State *state, const big_int &int_val)
     : NumericVal(
           state, &INT_TYPE,
-          state->get_z3_ctx()->int_val(Util::toString(int_val, 0, false))) {}
+          state->get_z3_ctx()->int_val(Util::toString(int_val, 0, false))) {
+    set_kind(P4Z3Kind::Z3Int);
+}
 
 Z3Int::Z3Int(const P4State *state, int64_t int_val)
-    : NumericVal(state, &INT_TYPE, state->get_z3_ctx()->int_val(int_val)) {}
+    : NumericVal(state, &INT_TYPE, state->get_z3_ctx()->int_val(int_val)) {
+    set_kind(P4Z3Kind::Z3Int);
+}
 
 Z3Int::Z3Int(const P4State *state)
-    : NumericVal(state, &INT_TYPE, state->get_z3_ctx()->int_val(0)) {}
+    : NumericVal(state, &INT_TYPE, state->get_z3_ctx()->int_val(0)) {
+    set_kind(P4Z3Kind::Z3Int);
+}
 
-Z3Int *Z3Int::copy() const { return new Z3Int(state, val); }
+Z3Int *Z3Int::copy() const { return state->allocate<Z3Int>(state, val); }
 
 void Z3Int::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     if (const auto *then_expr_var = then_expr.to<Z3Int>()) {
-        val = z3::ite(cond, then_expr_var->val, val);
+        if (!z3::eq(then_expr_var->val, val)) {
+            val = z3::ite(cond, then_expr_var->val, val);
+        }
     } else if (const auto *then_expr_var = then_expr.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, then_expr_var->get_val()->get_sort());
         val = z3::ite(cond, *then_expr_var->get_val(), cast_val);
@@ -433,54 +473,58 @@ void Z3Int::merge(const z3::expr &cond, const P4Z3Instance &then_expr) {
     }
 }
 
-P4Z3Instance *Z3Int::operator-() const { return new Z3Int(state, -val); }
+P4Z3Instance *Z3Int::operator-() const {
+    return state->allocate<Z3Int>(state, -val);
+}
 
 /****** BINARY OPERANDS ******/
 
 P4Z3Instance *Z3Int::operator*(const P4Z3Instance &other) const {
     if (const auto *other_int = other.to<Z3Int>()) {
-        return new Z3Int(state, val * other_int->val);
+        return state->allocate<Z3Int>(state, val * other_int->val);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val * *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val * *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("* not implemented for %s.", other.get_static_type());
 }
 
 P4Z3Instance *Z3Int::operator/(const P4Z3Instance &other) const {
     if (const auto *other_int = other.to<Z3Int>()) {
-        return new Z3Int(state, val / other_int->val);
+        return state->allocate<Z3Int>(state, val / other_int->val);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               z3::udiv(cast_val, *other_val->get_val()));
+        return state->allocate<Z3Bitvector>(
+            state, other_val->get_p4_type(),
+            z3::udiv(cast_val, *other_val->get_val()));
     }
     P4C_UNIMPLEMENTED("/ not implemented for %s.", other.get_static_type());
 }
 
 P4Z3Instance *Z3Int::operator%(const P4Z3Instance &other) const {
     if (const auto *other_int = other.to<Z3Int>()) {
-        return new Z3Int(state, val % other_int->val);
+        return state->allocate<Z3Int>(state, val % other_int->val);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               z3::urem(cast_val, *other_val->get_val()));
+        return state->allocate<Z3Bitvector>(
+            state, other_val->get_p4_type(),
+            z3::urem(cast_val, *other_val->get_val()));
     }
     P4C_UNIMPLEMENTED("% not implemented for %s.", other.get_static_type());
 }
 
 P4Z3Instance *Z3Int::operator+(const P4Z3Instance &other) const {
     if (const auto *other_int = other.to<Z3Int>()) {
-        return new Z3Int(state, val + other_int->val);
+        return state->allocate<Z3Int>(state, val + other_int->val);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val + *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val + *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("+ not implemented for %s.", other.get_static_type());
 }
@@ -495,22 +539,22 @@ P4Z3Instance *Z3Int::operatorAddSat(const P4Z3Instance &other) const {
         auto sort = cast_val.get_sort();
         cstring big_str = get_max_bv_val(sort.bv_size());
         auto max_val = state->get_z3_ctx()->bv_val(big_str, sort.bv_size());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               z3::ite(no_underflow && no_overflow,
-                                       cast_val + *other_val->get_val(),
-                                       max_val));
+        return state->allocate<Z3Bitvector>(
+            state, other_val->get_p4_type(),
+            z3::ite(no_underflow && no_overflow,
+                    cast_val + *other_val->get_val(), max_val));
     }
     P4C_UNIMPLEMENTED("|+| not implemented for %s.", other.get_static_type());
 }
 
 P4Z3Instance *Z3Int::operator-(const P4Z3Instance &other) const {
     if (const auto *other_int = other.to<Z3Int>()) {
-        return new Z3Int(state, val - other_int->val);
+        return state->allocate<Z3Int>(state, val - other_int->val);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val - *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val - *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("- not implemented for %s.", other.get_static_type());
 }
@@ -526,12 +570,13 @@ P4Z3Instance *Z3Int::operator>>(const P4Z3Instance &other) const {
         // Big int does not support huge shifts
         auto right = other_int->val.simplify().get_numeral_int64();
         auto result = big_int_left >> right;
-        return new Z3Int(state, result);
+        return state->allocate<Z3Int>(state, result);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         z3::expr cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               z3::lshr(cast_val, *other_val->get_val()));
+        return state->allocate<Z3Bitvector>(
+            state, other_val->get_p4_type(),
+            z3::lshr(cast_val, *other_val->get_val()));
     }
     P4C_UNIMPLEMENTED(">> not implemented for %s.", other.get_static_type());
 }
@@ -543,12 +588,13 @@ P4Z3Instance *Z3Int::operator<<(const P4Z3Instance &other) const {
         // Big int does not support huge shifts
         auto right = other_int->val.simplify().get_numeral_uint64();
         auto result = big_int_left << right;
-        return new Z3Int(state, result);
+        return state->allocate<Z3Int>(state, result);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         z3::expr cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               z3::shl(cast_val, *other_val->get_val()));
+        return state->allocate<Z3Bitvector>(
+            state, other_val->get_p4_type(),
+            z3::shl(cast_val, *other_val->get_val()));
     }
     P4C_UNIMPLEMENTED("<< not implemented for %s.", other.get_static_type());
 }
@@ -620,12 +666,12 @@ P4Z3Instance *Z3Int::operator&(const P4Z3Instance &other) const {
         auto left = big_int(val.simplify().get_decimal_string(0));
         auto right = big_int(other_int->val.simplify().get_decimal_string(0));
         auto result = left & right;
-        return new Z3Int(state, result);
+        return state->allocate<Z3Int>(state, result);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val & *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val & *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("& not implemented for %s.", other.get_static_type());
 }
@@ -635,12 +681,12 @@ P4Z3Instance *Z3Int::operator|(const P4Z3Instance &other) const {
         auto left = big_int(val.simplify().get_decimal_string(0));
         auto right = big_int(other_int->val.simplify().get_decimal_string(0));
         auto result = left | right;
-        return new Z3Int(state, result);
+        return state->allocate<Z3Int>(state, result);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val | *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val | *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("| not implemented for %s.", other.get_static_type());
 }
@@ -650,12 +696,12 @@ P4Z3Instance *Z3Int::operator^(const P4Z3Instance &other) const {
         auto left = big_int(val.simplify().get_decimal_string(0));
         auto right = big_int(other_int->val.simplify().get_decimal_string(0));
         auto result = left ^ right;
-        return new Z3Int(state, result);
+        return state->allocate<Z3Int>(state, result);
     }
     if (const auto *other_val = other.to<Z3Bitvector>()) {
         auto cast_val = pure_bv_cast(val, other_val->get_val()->get_sort());
-        return new Z3Bitvector(state, other_val->get_p4_type(),
-                               cast_val ^ *other_val->get_val());
+        return state->allocate<Z3Bitvector>(state, other_val->get_p4_type(),
+                                            cast_val ^ *other_val->get_val());
     }
     P4C_UNIMPLEMENTED("^ not implemented for %s.", other.get_static_type());
 }
@@ -667,10 +713,11 @@ P4Z3Instance *Z3Int::cast_allocate(const IR::Type *dest_type) const {
     if (const auto *tb = dest_type->to<IR::Type_Bits>()) {
         // TODO: Resolve this
         auto dest_sort = state->get_z3_ctx()->bv_sort(tb->size);
-        return new Z3Bitvector(state, tb, pure_bv_cast(val, dest_sort));
+        return state->allocate<Z3Bitvector>(state, tb,
+                                            pure_bv_cast(val, dest_sort));
     }
     if (const auto *tb = dest_type->to<IR::Type_Boolean>()) {
-        return new Z3Bitvector(state, tb, val != 0);
+        return state->allocate<Z3Bitvector>(state, tb, val != 0);
     }
     if (const auto *te = dest_type->to<IR::Type_Enum>()) {
         auto new_enum = *state->find_var(te->name.name)->to<EnumInstance>();
@@ -20,22 +20,26 @@ class P4State;
 z3::expr pure_bv_cast(const z3::expr &expr, const z3::sort &dest_type);
 
 class VoidResult : public P4Z3Instance {
+ private:
+    const P4State *state;
+
  public:
-    VoidResult() : P4Z3Instance(new IR::Type_Void()) {}
+    explicit VoidResult(const P4State *state)
+        : P4Z3Instance(&VOID_TYPE), state(state) {
+        set_kind(P4Z3Kind::VoidResult);
+    }
     void merge(const z3::expr & /*cond*/,
                const P4Z3Instance & /*then_expr*/) override {
         // Merge is a no-op here.
     }
-    VoidResult *copy() const override { return new VoidResult(); }
+    VoidResult *copy() const override;
     cstring get_static_type() const override { return "VoidResult"; }
     cstring to_string() const override {
         cstring ret = "VoidResult(";
         ret += ")";
         return ret;
     }
-    P4Z3Instance *cast_allocate(const IR::Type * /*dest_type*/) const override {
-        return new VoidResult();
-    }
+    P4Z3Instance *cast_allocate(const IR::Type *dest_type) const override;
 };
 
 class ValContainer {
@@ -54,18 +58,16 @@ class NumericVal : public P4Z3Instance, public ValContainer {
  public:
     explicit NumericVal(const P4State *state, const IR::Type *p4_type,
                         const z3::expr &val)
-        : P4Z3Instance(p4_type), ValContainer(val), state(state) {}
+        : P4Z3Instance(p4_type), ValContainer(val), state(state) {
+        set_kind(P4Z3Kind::NumericVal);
+    }
 
     cstring get_static_type() const override { return "NumericVal"; }
     cstring to_string() const override {
         cstring ret = "NumericVal(";
         return ret + val.to_string().c_str() + ")";
     }
-    void set_undefined() override {
-        auto sort = val.get_sort();
-        auto *ctx = &sort.ctx();
-        val = ctx->constant(UNDEF_LABEL, sort);
-    }
+    void set_undefined() override;
     NumericVal(const NumericVal &other)
         : P4Z3Instance(other), ValContainer(other.val), state(other.state) {}
 };
@@ -120,7 +122,9 @@ class Z3Bitvector : public NumericVal {
     // copy constructor
     Z3Bitvector(const Z3Bitvector &other)
         : NumericVal(other.state, other.p4_type, other.val), width(other.width),
-          is_signed(other.is_signed) {}
+          is_signed(other.is_signed) {
+        set_kind(P4Z3Kind::Z3Bitvector);
+    }
     // overload = operator
     Z3Bitvector &operator=(const Z3Bitvector &other) {
         if (this == &other) {
@@ -72,11 +72,13 @@ void process_table_properties(const IR::P4Table *p4t,
 }
 
 P4TableInstance::P4TableInstance(P4State *state, const IR::P4Table *p4t)
-    : P4Declaration(p4t), state(state),
-      hit(state->get_z3_ctx()->bool_val(false)) {
+    : P4Declaration(state, p4t), hit(state->get_z3_ctx()->bool_val(false)) {
+    set_kind(P4Z3Kind::P4TableInstance);
     members.insert({"action_run", this});
-    members.insert({"hit", new Z3Bitvector(state, &BOOL_TYPE, hit)});
-    members.insert({"miss", new Z3Bitvector(state, &BOOL_TYPE, !hit)});
+    members.insert(
+        {"hit", state->allocate<Z3Bitvector>(state, &BOOL_TYPE, hit)});
+    members.insert(
+        {"miss", state->allocate<Z3Bitvector>(state, &BOOL_TYPE, !hit)});
     cstring apply_str = "apply";
     apply_str += std::to_string(p4t->getApplyParameters()->size());
     add_function(apply_str, [this](Visitor *visitor,
@@ -99,11 +101,14 @@ P4TableInstance::P4TableInstance(P4State *state, const IR::P4Table *p4t)
 
 P4TableInstance::P4TableInstance(P4State *state, const IR::StatOrDecl *decl,
                                  z3::expr hit, TableProperties table_props)
-    : P4Declaration(decl), state(state), hit(hit),
+    : P4Declaration(state, decl), hit(hit),
       table_props(std::move(table_props)) {
+    set_kind(P4Z3Kind::P4TableInstance);
     members.insert({"action_run", this});
-    members.insert({"hit", new Z3Bitvector(state, &BOOL_TYPE, hit)});
-    members.insert({"miss", new Z3Bitvector(state, &BOOL_TYPE, !hit)});
+    members.insert(
+        {"hit", state->allocate<Z3Bitvector>(state, &BOOL_TYPE, hit)});
+    members.insert(
+        {"miss", state->allocate<Z3Bitvector>(state, &BOOL_TYPE, !hit)});
     cstring apply_str = "apply";
     if (const auto *table = decl->to<IR::P4Table>()) {
         apply_str += std::to_string(table->getApplyParameters()->size());
@@ -114,6 +119,11 @@ P4TableInstance::P4TableInstance(P4State *state, const IR::StatOrDecl *decl,
     });
 }
 
+P4TableInstance *P4TableInstance::copy() const {
+    return state->allocate<P4TableInstance>(state, get_decl(), hit,
+                                            table_props);
+}
+
 z3::expr compute_table_hit(Visitor *visitor, P4State *state, cstring table_name,
                            const std::vector<const IR::KeyElement *> &keys,
                            std::vector<const P4Z3Instance *> *evaluated_keys) {
@@ -264,7 +274,7 @@ void P4TableInstance::apply(Visitor *visitor,
                                          table_props.keys, &evaluated_keys)
                            .simplify();
 
-    std::vector<std::pair<z3::expr, VarMap>> action_vars;
+    std::vector<std::pair<z3::expr, VarSnapshot>> action_vars;
     bool has_exited = true;
 
     z3::expr matches = state->get_z3_ctx()->bool_val(false);
@@ -285,7 +295,7 @@ void P4TableInstance::apply(Visitor *visitor,
             state->pop_forward_cond();
             auto call_has_exited = state->has_exited();
             if (!call_has_exited) {
-                action_vars.emplace_back(cond, state->get_vars());
+                action_vars.emplace_back(cond, state->clone_vars());
             }
             has_exited = has_exited && call_has_exited;
             state->set_exit(false);
@@ -308,7 +318,7 @@ void P4TableInstance::apply(Visitor *visitor,
                 state->pop_forward_cond();
                 auto call_has_exited = state->has_exited();
                 if (!call_has_exited) {
-                    action_vars.emplace_back(cond, state->get_vars());
+                    action_vars.emplace_back(cond, state->clone_vars());
                 }
                 has_exited = has_exited && call_has_exited;
                 state->set_exit(false);
@@ -335,8 +345,8 @@ void P4TableInstance::apply(Visitor *visitor,
     for (auto it = action_vars.rbegin(); it != action_vars.rend(); ++it) {
         state->merge_vars(it->first, it->second);
     }
-    state->set_expr_result(
-        new P4TableInstance(state, get_decl(), new_hit, table_props));
+    state->set_expr_result(state->allocate<P4TableInstance>(
+        state, get_decl(), new_hit, table_props));
 
     state->copy_out();
 }
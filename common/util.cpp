@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 
 namespace TOZ3 {
 
@@ -86,4 +88,81 @@ bool compare_files(const cstring &filename1, const cstring &filename2) {
                       begin2);  // Second argument is end-of-range iterator
 }
 
+uint64_t hash_content(const std::string &content, uint64_t seed) {
+    constexpr uint64_t fnv_prime = 1099511628211ULL;
+    uint64_t hash = seed;
+    for (const auto byte : content) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+std::string hash_to_string(uint64_t hash) {
+    std::stringstream hash_str;
+    hash_str << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hash_str.str();
+}
+
+void LogBuffer::flush() {
+    std::vector<std::pair<size_t, std::string>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.swap(messages);
+    }
+    for (auto &message : pending) {
+        Logger::log_msg(message.first, "%s", message.second);
+    }
+}
+
+static std::mutex &get_p4c_mutex() {
+    static std::mutex p4c_mutex;
+    return p4c_mutex;
+}
+
+static thread_local ICompileContext *thread_context = nullptr;
+
+P4CSection::P4CSection() : lock(get_p4c_mutex()) {
+    if (thread_context != nullptr) {
+        active_context = std::make_unique<AutoCompileContext>(thread_context);
+    }
+}
+
+// Pops the context before the lock is released.
+P4CSection::~P4CSection() { active_context.reset(); }
+
+void P4CSection::set_thread_context(ICompileContext *context) {
+    thread_context = context;
+}
+
+cstring get_exit_class(int exit_code) {
+    switch (exit_code) {
+    case EXIT_SUCCESS:
+        return "EXIT_SUCCESS";
+    case EXIT_SKIPPED:
+        return "EXIT_SKIPPED";
+    case EXIT_VIOLATION:
+        return "EXIT_VIOLATION";
+    case EXIT_UNDEF:
+        return "EXIT_UNDEF";
+    default:
+        return "EXIT_FAILURE";
+    }
+}
+
+std::string escape_json(const std::string &str) {
+    std::stringstream escaped;
+    for (auto chr : str) {
+        if (chr == '"' || chr == '\\') {
+            escaped << '\\' << chr;
+        } else if (static_cast<unsigned char>(chr) < 0x20) {
+            escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                    << static_cast<int>(chr) << std::dec;
+        } else {
+            escaped << chr;
+        }
+    }
+    return escaped.str();
+}
+
 }  // namespace TOZ3
@@ -1,9 +1,14 @@
 #ifndef TOZ3_COMMON_UTIL_H_
 #define TOZ3_COMMON_UTIL_H_
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "ir/ir.h"
+#include "lib/compile_context.h"
 
 // The program is empty, there is nothing to do here
 #define EXIT_SKIPPED 10
@@ -25,11 +30,56 @@ cstring get_max_bv_val(uint64_t bv_width);
 cstring infer_name(const IR::Annotations *annots, cstring default_name);
 bool compare_files(const cstring &filename1, const cstring &filename2);
 int exec(const char *cmd, std::stringstream &output);
+// 64-bit FNV-1a hash. Pass a previous hash as seed to chain contents.
+uint64_t hash_content(const std::string &content,
+                      uint64_t seed = 14695981039346656037ULL);
+std::string hash_to_string(uint64_t hash);
+// Name of an exit code of the tools, e.g. EXIT_VIOLATION.
+cstring get_exit_class(int exit_code);
+std::string escape_json(const std::string &str);
+// P4C keeps the cstring table, the IR node ids and the compile context stack
+// in unsynchronized process-global state. Threads hold a P4CSection while
+// they parse, visit or create cstrings and IR nodes, and only then. The
+// section activates the compile context of the calling thread, so errors are
+// reported to that thread. Sections do not nest. All sections share one
+// lock, so threads never parse or interpret at the same time, until P4C
+// makes these tables thread-local.
+class P4CSection {
+ private:
+    std::lock_guard<std::mutex> lock;
+    std::unique_ptr<AutoCompileContext> active_context;
+
+ public:
+    P4CSection();
+    ~P4CSection();
+    P4CSection(const P4CSection &) = delete;
+    P4CSection &operator=(const P4CSection &) = delete;
+    // Sections of the calling thread activate this context. Threads without
+    // a context use whatever the main thread has activated.
+    static void set_thread_context(ICompileContext *context);
+};
+
+// Collects the messages of a thread that must not use the P4C log, for
+// example because another thread runs passes at the same time. The owner
+// logs them with flush() where P4C is safe to use.
+class LogBuffer {
+ private:
+    std::mutex mutex;
+    std::vector<std::pair<size_t, std::string>> messages;
+
+ public:
+    void add(size_t level, std::string msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages.emplace_back(level, std::move(msg));
+    }
+    void flush();
+};
 
 class Logger {
  public:
     static void init() {
-        cstring reg_str = cstring(__FILE__) + ":" + std::to_string(LOG_LEVEL);
+        std::lock_guard<std::mutex> lock(get_mutex());
+        auto reg_str = std::string(__FILE__) + ":" + std::to_string(LOG_LEVEL);
         Log::addDebugSpec(reg_str.c_str());
     }
     template <typename... Args>
@@ -39,10 +89,42 @@ class Logger {
         }
         boost::format f(msg);
         std::initializer_list<char>{(static_cast<void>(f % args), char{})...};
+        if (auto *buffer = get_thread_buffer()) {
+            buffer->add(level, boost::str(f));
+            return;
+        }
+        // The P4C log caches its levels in global state.
+        std::lock_guard<std::mutex> lock(get_mutex());
         LOGN(level, boost::str(f));
     }
-};
+    // Lets callers skip building messages that are not logged.
+    static bool is_enabled(size_t level) {
+        if (level > LOG_LEVEL) {
+            return false;
+        }
+        // The level is only checked once the buffer is flushed.
+        if (get_thread_buffer() != nullptr) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(get_mutex());
+        return LOGGING(level);
+    }
+    // Messages of the calling thread go to this buffer instead of the P4C
+    // log. Pass null to log directly again.
+    static void set_thread_buffer(LogBuffer *buffer) {
+        get_thread_buffer() = buffer;
+    }
+    static LogBuffer *&get_thread_buffer() {
+        thread_local LogBuffer *buffer = nullptr;
+        return buffer;
+    }
 
+ private:
+    static std::mutex &get_mutex() {
+        static std::mutex log_mutex;
+        return log_mutex;
+    }
+};
 
 }  // namespace TOZ3
 
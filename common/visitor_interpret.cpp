@@ -39,7 +39,8 @@ bool Z3Visitor::preorder(const IR::Type_Enum *t) {
         }
     } else {
         state->add_type(name, t);
-        state->declare_var(name, new EnumInstance(state, t, "", 0), t);
+        auto *enum_instance = state->allocate<EnumInstance>(state, t, "", 0);
+        state->declare_var(name, enum_instance, t);
     }
     return false;
 }
@@ -61,7 +62,9 @@ bool Z3Visitor::preorder(const IR::Type_Error *t) {
         }
     } else {
         state->add_type(name, t);
-        state->declare_var(name, new ErrorInstance(state, t, "", 0), t);
+        auto *error_instance =
+            state->allocate<ErrorInstance>(state, t, "", 0);
+        state->declare_var(name, error_instance, t);
     }
     return false;
 }
@@ -92,8 +95,9 @@ bool Z3Visitor::preorder(const IR::Type_SerEnum *t) {
                 state->get_expr_result()->cast_allocate(member_type));
         }
         state->add_type(name, t);
-        state->declare_var(
-            name, new SerEnumInstance(state, input_members, t, "", 0), t);
+        auto *enum_instance = state->allocate<SerEnumInstance>(
+            state, input_members, t, "", 0);
+        state->declare_var(name, enum_instance, t);
     }
     return false;
 }
@@ -141,7 +145,8 @@ bool Z3Visitor::preorder(const IR::P4Parser *p) {
     // Parsers can be both a var and a type
     // TODO: Take a closer look at this...
     state->add_type(p->name.name, p);
-    state->declare_var(p->name.name, new ControlInstance(state, p, {}), p);
+    state->declare_var(p->name.name,
+                       state->allocate<ControlInstance>(state, p, VarMap()), p);
     return false;
 }
 
@@ -149,7 +154,8 @@ bool Z3Visitor::preorder(const IR::P4Control *c) {
     // Controls can be both a decl and a type
     // TODO: Take a closer look at this...
     state->add_type(c->name.name, c);
-    state->declare_var(c->name.name, new ControlInstance(state, c, {}), c);
+    state->declare_var(c->name.name,
+                       state->allocate<ControlInstance>(state, c, VarMap()), c);
 
     return false;
 }
@@ -166,7 +172,7 @@ bool Z3Visitor::preorder(const IR::Function *f) {
             num_params += 1;
         }
     }
-    auto *decl = new P4Declaration(f);
+    auto *decl = state->allocate<P4Declaration>(state, f);
     for (auto idx = 0; idx <= num_optional_params; ++idx) {
         // The IR has bizarre side effects when storing pointers in a map
         // TODO: Think about how to simplify this, maybe use their vector
@@ -188,7 +194,7 @@ bool Z3Visitor::preorder(const IR::Method *m) {
             num_params += 1;
         }
     }
-    auto *decl = new P4Declaration(m);
+    auto *decl = state->allocate<P4Declaration>(state, m);
     for (auto idx = 0; idx <= num_optional_params; ++idx) {
         // The IR has bizarre side effects when storing pointers in a map
         // TODO: Think about how to simplify this, maybe use their vector
@@ -211,7 +217,7 @@ bool Z3Visitor::preorder(const IR::P4Action *a) {
             num_params += 1;
         }
     }
-    auto *decl = new P4Declaration(a);
+    auto *decl = state->allocate<P4Declaration>(state, a);
     cstring name_basic = overloaded_name + std::to_string(num_params);
     state->declare_static_decl(name_basic, decl);
     // The IR has bizarre side effects when storing pointers in a map
@@ -225,7 +231,8 @@ bool Z3Visitor::preorder(const IR::P4Action *a) {
 }
 
 bool Z3Visitor::preorder(const IR::P4Table *t) {
-    state->declare_static_decl(t->name.name, new P4TableInstance(state, t));
+    state->declare_static_decl(t->name.name,
+                               state->allocate<P4TableInstance>(state, t));
     return false;
 }
 
@@ -234,7 +241,8 @@ bool Z3Visitor::preorder(const IR::Declaration_Instance *di) {
     const IR::Type *resolved_type = state->resolve_type(di->type);
     // TODO: Figure out a way to process packages
     if (resolved_type->is<IR::Type_Package>()) {
-        state->declare_static_decl(instance_name, new P4Declaration(di));
+        state->declare_static_decl(
+            instance_name, state->allocate<P4Declaration>(state, di));
         return false;
     }
     if (const auto *te = resolved_type->to<IR::Type_Extern>()) {
@@ -242,7 +250,8 @@ bool Z3Visitor::preorder(const IR::Declaration_Instance *di) {
         // const auto *ext_const = te->lookupConstructor(di->arguments);
         // const IR::ParameterList *params = nullptr;
         // params = ext_const->getParameters();
-        state->declare_var(instance_name, new ExternInstance(state, te), te);
+        state->declare_var(instance_name,
+                           state->allocate<ExternInstance>(state, te), te);
         return false;
     }
     if (const auto *ctrl_decl = resolved_type->to<IR::Type_Declaration>()) {
@@ -262,7 +271,8 @@ bool Z3Visitor::preorder(const IR::Declaration_Instance *di) {
                                                      *params, *type_params);
         state->declare_var(
             instance_name,
-            new ControlInstance(state, ctrl_decl, var_map.second), ctrl_decl);
+            state->allocate<ControlInstance>(state, ctrl_decl, var_map.second),
+            ctrl_decl);
         return false;
     }
     P4C_UNIMPLEMENTED("Resolved type %s of type %s not supported, ",
@@ -410,7 +420,8 @@ bool Z3Visitor::preorder(const IR::ExitStatement * /*e*/) {
             auto source = arg_tuple.second;
             auto *val = state->get_var(source);
             // Exit in parsers means that everything is invalid
-            if (in_parser) {
+            if (in_parser && val->is<StructBase>()) {
+                val = state->get_mut_var(source);
                 if (auto *si = val->to_mut<StructBase>()) {
                     auto invalid_bool = state->get_z3_ctx()->bool_val(false);
                     si->propagate_validity(&invalid_bool);
@@ -621,7 +632,7 @@ bool Z3Visitor::preorder(const IR::SwitchStatement *ss) {
     BUG_CHECK(!stmt_vector.empty(), "Statement vector can not be empty.");
     bool has_exited = true;
     bool has_returned = true;
-    std::vector<std::pair<z3::expr, VarMap>> case_states;
+    std::vector<std::pair<z3::expr, VarSnapshot>> case_states;
     for (auto &stmt : stmt_vector) {
         auto case_match = stmt.first;
         const auto *case_stmt = stmt.second;
@@ -632,7 +643,7 @@ bool Z3Visitor::preorder(const IR::SwitchStatement *ss) {
         auto call_has_exited = state->has_exited();
         auto stmt_has_returned = state->has_returned();
         if (!(call_has_exited || stmt_has_returned)) {
-            case_states.emplace_back(case_match, state->get_vars());
+            case_states.emplace_back(case_match, state->clone_vars());
         }
         has_exited = has_exited && call_has_exited;
         has_returned = has_returned && stmt_has_returned;
@@ -672,7 +683,7 @@ bool Z3Visitor::preorder(const IR::IfStatement *ifs) {
     state->pop_forward_cond();
     auto then_has_exited = state->has_exited();
     auto then_has_returned = state->has_returned();
-    VarMap then_vars;
+    VarSnapshot then_vars;
     if (then_has_exited || then_has_returned) {
         then_vars = old_vars;
     } else {
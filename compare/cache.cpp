@@ -0,0 +1,519 @@
+#include "cache.h"
+
+#include <array>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "boost/filesystem.hpp"
+
+#include "toz3/common/util.h"
+#include "version.h"
+
+namespace TOZ3 {
+
+namespace fs = boost::filesystem;
+
+static fs::path get_repr_path(cstring cache_dir, uint64_t key) {
+    return fs::path(cache_dir.c_str()) /
+           (hash_to_string(key) + ".smt2").c_str();
+}
+
+static fs::path get_result_path(cstring cache_dir, uint64_t key) {
+    return fs::path(cache_dir.c_str()) / RESULT_DIR /
+           (hash_to_string(key) + ".smt2").c_str();
+}
+
+static std::string to_smt2(z3::context *ctx,
+                           const std::vector<Z3_ast> &assertions) {
+    // The printer shares common sub-expressions with let bindings.
+    return Z3_benchmark_to_smtlib_string(*ctx, "", "", "unknown", "",
+                                         assertions.size(), assertions.data(),
+                                         ctx->bool_val(true));
+}
+
+static void write_cache_file(const fs::path &path, const std::string &content) {
+    fs::create_directories(path.parent_path());
+    // Write to a temporary file first, concurrent runs may share the cache.
+    auto tmp_path = path;
+    tmp_path += fs::unique_path(".%%%%-%%%%");
+    {
+        std::ofstream cache_file(tmp_path.c_str());
+        cache_file << content;
+    }
+    boost::system::error_code ec;
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        fs::remove(tmp_path, ec);
+    }
+}
+
+static void touch_cache_file(const fs::path &path) {
+    // Eviction removes the least recently used entries first.
+    boost::system::error_code ec;
+    fs::last_write_time(path, std::time(nullptr), ec);
+}
+
+bool get_repr_cache_key(ParserOptions *options, uint64_t *key) {
+    FILE *input = nullptr;
+    {
+        P4CSection section;
+        input = options->preprocess();
+    }
+    if (input == nullptr) {
+        return false;
+    }
+    std::string program;
+    constexpr int chunk_size = 4096;
+    std::array<char, chunk_size> buffer{};
+    size_t read_bytes = 0;
+    while ((read_bytes = fread(buffer.data(), 1, chunk_size, input)) > 0) {
+        program.append(buffer.data(), read_bytes);
+    }
+    options->closeInput(input);
+    *key = hash_content(program, hash_content(TOZ3_REPR_VERSION));
+    return true;
+}
+
+static std::string get_preprocessor_flags(ParserOptions *options) {
+    auto flags = options->preprocessor_options;
+    return flags != nullptr ? flags.c_str() : "";
+}
+
+static std::vector<fs::path> get_include_dirs(ParserOptions *options) {
+    std::vector<fs::path> include_dirs;
+    std::istringstream flags(get_preprocessor_flags(options));
+    std::string flag;
+    while (flags >> flag) {
+        if (flag == "-I" && flags >> flag) {
+            include_dirs.emplace_back(flag);
+        } else if (flag.compare(0, 2, "-I") == 0) {
+            include_dirs.emplace_back(flag.substr(2));
+        }
+    }
+    // The preprocessor looks into the P4 include folder last.
+    const char *p4_include = getenv("P4C_16_INCLUDE_PATH");
+    include_dirs.emplace_back(p4_include != nullptr ? p4_include
+                                                    : p4includePath);
+    return include_dirs;
+}
+
+// Returns false if the line is not an include. Otherwise include is the
+// included file, or empty if it cannot be found.
+static bool parse_include(const std::string &line, const fs::path &parent,
+                          const std::vector<fs::path> &include_dirs,
+                          fs::path *include) {
+    auto pos = line.find_first_not_of(" \t");
+    if (pos == std::string::npos || line[pos] != '#') {
+        return false;
+    }
+    pos = line.find_first_not_of(" \t", pos + 1);
+    if (pos == std::string::npos || line.compare(pos, 7, "include") != 0) {
+        return false;
+    }
+    include->clear();
+    pos = line.find_first_of("<\"", pos);
+    if (pos == std::string::npos) {
+        return true;
+    }
+    auto end = line.find(line[pos] == '<' ? '>' : '"', pos + 1);
+    if (end == std::string::npos) {
+        return true;
+    }
+    auto name = line.substr(pos + 1, end - pos - 1);
+    boost::system::error_code ec;
+    // Quoted includes are looked up next to the including file first.
+    if (line[pos] == '"' && fs::is_regular_file(parent / name, ec)) {
+        *include = parent / name;
+        return true;
+    }
+    for (const auto &dir : include_dirs) {
+        if (fs::is_regular_file(dir / name, ec)) {
+            *include = dir / name;
+            return true;
+        }
+    }
+    return true;
+}
+
+// The included headers rarely change, so their hashes are kept as long as
+// the file is not modified.
+static uint64_t hash_include(const fs::path &path, const std::string &content) {
+    static std::mutex include_mutex;
+    static std::map<std::string, std::pair<std::time_t, uint64_t>> hashes;
+    boost::system::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    std::lock_guard<std::mutex> lock(include_mutex);
+    auto it = hashes.find(path.string());
+    if (!ec && it != hashes.end() && it->second.first == mtime) {
+        return it->second.second;
+    }
+    auto hash = hash_content(content);
+    if (!ec) {
+        hashes[path.string()] = {mtime, hash};
+    }
+    return hash;
+}
+
+// Adds the file and everything it includes to the key, in include order.
+// Includes are scanned regardless of conditionals, which only makes the
+// key cover more than the preprocessor would read.
+static bool hash_source_tree(const fs::path &path, const uint64_t *known_hash,
+                             const std::vector<fs::path> &include_dirs,
+                             std::set<std::string> *visited, uint64_t *key) {
+    bool is_root = visited->empty();
+    if (!visited->insert(path.string()).second) {
+        return true;
+    }
+    std::ifstream source_file(path.c_str());
+    if (!source_file.is_open()) {
+        return false;
+    }
+    std::stringstream content;
+    content << source_file.rdbuf();
+    uint64_t hash = 0;
+    if (known_hash != nullptr) {
+        hash = *known_hash;
+    } else if (is_root) {
+        hash = hash_content(content.str());
+    } else {
+        hash = hash_include(path, content.str());
+    }
+    *key = hash_content(path.string() + ":" + hash_to_string(hash), *key);
+    std::string line;
+    fs::path include;
+    while (std::getline(content, line)) {
+        if (!parse_include(line, path.parent_path(), include_dirs, &include)) {
+            continue;
+        }
+        if (include.empty() ||
+            !hash_source_tree(include, nullptr, include_dirs, visited, key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool get_source_cache_key(ParserOptions *options, const uint64_t *source_hash,
+                          uint64_t *key) {
+    auto include_dirs = get_include_dirs(options);
+    std::set<std::string> visited;
+    // Without the preprocessor, its flags must be part of the key.
+    *key = hash_content(std::string(TOZ3_REPR_VERSION) + "-source " +
+                        get_preprocessor_flags(options));
+    return hash_source_tree(options->file.c_str(), source_hash, include_dirs,
+                            &visited, key);
+}
+
+bool read_z3_repr(z3::context *ctx, const std::string &path, Z3Fields *fields,
+                  std::vector<z3::expr> *undefined_vars) {
+    std::ifstream repr_file(path);
+    if (!repr_file.is_open()) {
+        return false;
+    }
+    // The header lists the field names and the original names of the
+    // undefined constants as SMT-LIB2 comments.
+    std::string line;
+    size_t num_fields = 0;
+    size_t num_undefined = 0;
+    if (!std::getline(repr_file, line) ||
+        sscanf(line.c_str(), "; %zu %zu", &num_fields, &num_undefined) != 2) {
+        return false;
+    }
+    std::vector<std::string> names;
+    for (size_t idx = 0; idx < num_fields + num_undefined; ++idx) {
+        if (!std::getline(repr_file, line) || line.size() < 2) {
+            return false;
+        }
+        names.push_back(line.substr(2));
+    }
+    std::stringstream smt_str;
+    smt_str << repr_file.rdbuf();
+    try {
+        auto equalities = ctx->parse_string(smt_str.str().c_str());
+        if (equalities.size() < num_fields + num_undefined) {
+            return false;
+        }
+        for (size_t idx = 0; idx < equalities.size(); ++idx) {
+            if (!equalities[idx].is_eq()) {
+                return false;
+            }
+        }
+        // Restore the original undefined constants, so the program shares
+        // them with programs that were interpreted in this process.
+        z3::expr_vector src(*ctx);
+        z3::expr_vector dst(*ctx);
+        for (size_t idx = 0; idx < num_undefined; ++idx) {
+            auto renamed = equalities[num_fields + idx].arg(1);
+            auto original = ctx->constant(names[num_fields + idx].c_str(),
+                                          renamed.get_sort());
+            src.push_back(renamed);
+            dst.push_back(original);
+            undefined_vars->push_back(original);
+        }
+        // Field names are interned, create them in one section.
+        P4CSection section;
+        for (size_t idx = 0; idx < num_fields; ++idx) {
+            auto field = equalities[idx].arg(1);
+            if (!src.empty()) {
+                field = field.substitute(src, dst);
+            }
+            fields->emplace_back(cstring(names[idx]), field);
+        }
+    } catch (z3::exception &ex) {
+        Logger::log_msg(1, "Discarding representation: %s", ex);
+        fields->clear();
+        undefined_vars->clear();
+        return false;
+    }
+    return true;
+}
+
+static std::string get_sort_label(const z3::sort &sort) {
+    if (sort.is_bv()) {
+        return "bv" + std::to_string(sort.bv_size());
+    }
+    if (sort.is_bool()) {
+        return "bool";
+    }
+    return "sort" + std::to_string(sort.sort_kind());
+}
+
+// The interpreter names most undefined constants UNDEF_LABEL, which only
+// differ by their sort and can not be told apart in SMT-LIB2. Gives every
+// recorded constant a unique name of the form undefined_<sort>_<n> in the
+// file. read_z3_repr maps them back to their original names.
+static void rename_undefined(z3::context *ctx, z3::expr_vector *exprs,
+                             const std::vector<z3::expr> &undefined_vars) {
+    z3::expr_vector src(*ctx);
+    z3::expr_vector dst(*ctx);
+    for (const auto &var : undefined_vars) {
+        auto undef_name = std::string(UNDEF_LABEL) + "_" +
+                          get_sort_label(var.get_sort()) + "_" +
+                          std::to_string(src.size());
+        src.push_back(var);
+        dst.push_back(ctx->constant(undef_name.c_str(), var.get_sort()));
+    }
+    if (src.empty()) {
+        return;
+    }
+    z3::expr_vector renamed(*ctx);
+    for (size_t idx = 0; idx < exprs->size(); ++idx) {
+        renamed.push_back((*exprs)[idx].substitute(src, dst));
+    }
+    *exprs = renamed;
+}
+
+void write_z3_repr(z3::context *ctx, const std::string &path,
+                   const Z3Fields &fields,
+                   const std::vector<z3::expr> &undefined_vars) {
+    // The undefined constants follow the fields.
+    z3::expr_vector exprs(*ctx);
+    for (const auto &field : fields) {
+        exprs.push_back(field.second);
+    }
+    for (const auto &var : undefined_vars) {
+        exprs.push_back(var);
+    }
+    rename_undefined(ctx, &exprs, undefined_vars);
+    // Every expression is stored as an equality with a placeholder constant.
+    z3::expr_vector equalities(*ctx);
+    std::vector<Z3_ast> equality_asts;
+    for (size_t idx = 0; idx < exprs.size(); ++idx) {
+        auto placeholder_name = CACHE_LABEL + std::to_string(idx);
+        auto placeholder = ctx->constant(placeholder_name.c_str(),
+                                         exprs[idx].get_sort());
+        equalities.push_back(placeholder == exprs[idx]);
+        equality_asts.push_back(equalities.back());
+    }
+    std::stringstream repr_str;
+    repr_str << "; " << fields.size() << " " << undefined_vars.size() << "\n";
+    for (const auto &field : fields) {
+        repr_str << "; " << field.first << "\n";
+    }
+    for (const auto &var : undefined_vars) {
+        repr_str << "; " << var.decl().name().str() << "\n";
+    }
+    repr_str << to_smt2(ctx, equality_asts);
+    write_cache_file(path, repr_str.str());
+}
+
+bool load_z3_repr(z3::context *ctx, cstring cache_dir, uint64_t key,
+                  Z3Fields *fields, std::vector<z3::expr> *undefined_vars) {
+    auto repr_path = get_repr_path(cache_dir, key);
+    if (!read_z3_repr(ctx, repr_path.string(), fields, undefined_vars)) {
+        return false;
+    }
+    touch_cache_file(repr_path);
+    return true;
+}
+
+void store_z3_repr(z3::context *ctx, cstring cache_dir, uint64_t key,
+                   const Z3Fields &fields,
+                   const std::vector<z3::expr> &undefined_vars) {
+    write_z3_repr(ctx, get_repr_path(cache_dir, key).string(), fields,
+                  undefined_vars);
+}
+
+// Describes a single node of a query, without its arguments. Z3 numbers
+// fresh constants per context, so they are named by their first appearance.
+static std::string describe_query_node(const z3::expr &expr,
+                                       std::map<unsigned, size_t> *fresh_ids) {
+    std::stringstream node_str;
+    if (!expr.is_app()) {
+        // Our queries do not contain quantifiers, print them in full.
+        node_str << expr;
+        return node_str.str();
+    }
+    auto decl = expr.decl();
+    node_str << decl.decl_kind() << " " << expr.get_sort();
+    if (expr.is_numeral()) {
+        node_str << " " << Z3_get_numeral_string(expr.ctx(), expr);
+    } else if (decl.decl_kind() == Z3_OP_UNINTERPRETED) {
+        auto name = decl.name().str();
+        if (name.find('!') != std::string::npos) {
+            auto fresh_id = fresh_ids->emplace(decl.id(), fresh_ids->size());
+            name = name.substr(0, name.find('!') + 1) +
+                   std::to_string(fresh_id.first->second);
+        }
+        node_str << " " << name;
+    }
+    // Parameters such as the bounds of an extract.
+    auto num_params = Z3_get_decl_num_parameters(expr.ctx(), decl);
+    for (unsigned idx = 0; idx < num_params; ++idx) {
+        if (Z3_get_decl_parameter_kind(expr.ctx(), decl, idx) ==
+            Z3_PARAMETER_INT) {
+            node_str << " " << Z3_get_decl_int_parameter(expr.ctx(), decl, idx);
+        }
+    }
+    return node_str.str();
+}
+
+uint64_t get_query_cache_key(const z3::expr &query) {
+    auto seed = hash_content(TOZ3_REPR_VERSION);
+    // Hashes the DAG bottom-up, every node only once.
+    std::map<unsigned, uint64_t> node_hashes;
+    std::map<unsigned, size_t> fresh_ids;
+    std::vector<std::pair<z3::expr, bool>> worklist = {{query, false}};
+    while (!worklist.empty()) {
+        auto item = worklist.back();
+        worklist.pop_back();
+        const auto &expr = item.first;
+        if (node_hashes.count(expr.id()) > 0) {
+            continue;
+        }
+        if (!item.second && expr.is_app() && expr.num_args() > 0) {
+            worklist.emplace_back(expr, true);
+            for (unsigned idx = expr.num_args(); idx > 0; --idx) {
+                worklist.emplace_back(expr.arg(idx - 1), false);
+            }
+            continue;
+        }
+        auto node_str = describe_query_node(expr, &fresh_ids);
+        for (unsigned idx = 0; expr.is_app() && idx < expr.num_args(); ++idx) {
+            node_str += " " + hash_to_string(node_hashes[expr.arg(idx).id()]);
+        }
+        node_hashes[expr.id()] = hash_content(node_str, seed);
+    }
+    return node_hashes[query.id()];
+}
+
+bool load_check_result(z3::context *ctx, cstring cache_dir, uint64_t key,
+                       z3::check_result *result, z3::model *model) {
+    auto result_path = get_result_path(cache_dir, key);
+    std::ifstream result_file(result_path.c_str());
+    if (!result_file.is_open()) {
+        return false;
+    }
+    std::string line;
+    if (!std::getline(result_file, line)) {
+        return false;
+    }
+    if (line == "; unsat") {
+        *result = z3::unsat;
+    } else if (line == "; sat") {
+        *result = z3::sat;
+    } else {
+        return false;
+    }
+    // The counterexample is stored as equalities of constants and values.
+    std::stringstream smt_str;
+    smt_str << result_file.rdbuf();
+    try {
+        z3::model cached_model(*ctx);
+        auto equalities = ctx->parse_string(smt_str.str().c_str());
+        for (size_t idx = 0; idx < equalities.size(); ++idx) {
+            auto equality = equalities[idx];
+            if (!equality.is_eq()) {
+                continue;
+            }
+            auto decl = equality.arg(0).decl();
+            auto value = equality.arg(1);
+            cached_model.add_const_interp(decl, value);
+        }
+        *model = cached_model;
+    } catch (z3::exception &ex) {
+        Logger::log_msg(1, "Discarding cache entry: %s", ex);
+        return false;
+    }
+    touch_cache_file(result_path);
+    return true;
+}
+
+void store_check_result(z3::context *ctx, cstring cache_dir, uint64_t key,
+                        z3::check_result result, const z3::model &model) {
+    if (result == z3::unknown) {
+        return;
+    }
+    std::stringstream result_str;
+    result_str << "; " << result << "\n";
+    if (result == z3::sat) {
+        z3::expr_vector equalities(*ctx);
+        std::vector<Z3_ast> equality_asts;
+        for (size_t idx = 0; idx < model.num_consts(); ++idx) {
+            auto decl = model.get_const_decl(idx);
+            equalities.push_back(decl() == model.get_const_interp(decl));
+            equality_asts.push_back(equalities.back());
+        }
+        result_str << to_smt2(ctx, equality_asts);
+    }
+    write_cache_file(get_result_path(cache_dir, key), result_str.str());
+}
+
+void evict_cache(cstring cache_dir, uint64_t max_bytes) {
+    boost::system::error_code ec;
+    std::vector<std::pair<std::time_t, fs::path>> entries;
+    uint64_t total_bytes = 0;
+    for (fs::recursive_directory_iterator it(cache_dir.c_str(), ec), end;
+         !ec && it != end; it.increment(ec)) {
+        if (!fs::is_regular_file(it->path(), ec)) {
+            continue;
+        }
+        total_bytes += fs::file_size(it->path(), ec);
+        entries.emplace_back(fs::last_write_time(it->path(), ec), it->path());
+    }
+    if (total_bytes <= max_bytes) {
+        return;
+    }
+    // Remove the least recently used entries until the cache fits.
+    std::sort(entries.begin(), entries.end());
+    for (const auto &entry : entries) {
+        if (total_bytes <= max_bytes) {
+            break;
+        }
+        auto entry_bytes = fs::file_size(entry.second, ec);
+        if (fs::remove(entry.second, ec)) {
+            total_bytes -= std::min(total_bytes, entry_bytes);
+        }
+    }
+    Logger::log_msg(1, "Evicted cache entries, %s bytes remain.", total_bytes);
+}
+
+}  // namespace TOZ3
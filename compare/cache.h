@@ -0,0 +1,74 @@
+#ifndef TOZ3_COMPARE_CACHE_H_
+#define TOZ3_COMPARE_CACHE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../contrib/z3/z3++.h"
+#include "frontends/common/options.h"
+#include "ir/ir.h"
+
+namespace TOZ3 {
+// Prefix of the placeholder constants in the cached SMT-LIB2 files.
+constexpr auto CACHE_LABEL = "toz3_cache_field";
+// Sub folder of the cache which holds the solver results.
+constexpr auto RESULT_DIR = "results";
+
+using Z3Fields = std::vector<std::pair<cstring, z3::expr>>;
+
+// Computes the cache key of the program in options->file.
+// The key covers the preprocessed program, including all its includes.
+bool get_repr_cache_key(ParserOptions *options, uint64_t *key);
+// Like above, but covers the raw source and the files it includes, without
+// running the preprocessor. source_hash is the hash_content of the source,
+// if the caller already has it, or null. Returns false if an include cannot
+// be found.
+bool get_source_cache_key(ParserOptions *options, const uint64_t *source_hash,
+                          uint64_t *key);
+// Reads and writes the SMT-LIB2 form of a program's representation: its
+// fields and the constants that stand for undefined values. The cache and
+// the interpreter workers share this format.
+bool read_z3_repr(z3::context *ctx, const std::string &path, Z3Fields *fields,
+                  std::vector<z3::expr> *undefined_vars);
+void write_z3_repr(z3::context *ctx, const std::string &path,
+                   const Z3Fields &fields,
+                   const std::vector<z3::expr> &undefined_vars);
+bool load_z3_repr(z3::context *ctx, cstring cache_dir, uint64_t key,
+                  Z3Fields *fields, std::vector<z3::expr> *undefined_vars);
+void store_z3_repr(z3::context *ctx, cstring cache_dir, uint64_t key,
+                   const Z3Fields &fields,
+                   const std::vector<z3::expr> &undefined_vars);
+
+// Computes the cache key of a query from its structure. Fresh constants,
+// such as the taint variables, are renamed by their order of appearance, so
+// the key is the same across runs.
+uint64_t get_query_cache_key(const z3::expr &query);
+bool load_check_result(z3::context *ctx, cstring cache_dir, uint64_t key,
+                       z3::check_result *result, z3::model *model);
+void store_check_result(z3::context *ctx, cstring cache_dir, uint64_t key,
+                        z3::check_result result, const z3::model &model);
+// Removes the least recently used entries until the cache fits max_bytes.
+void evict_cache(cstring cache_dir, uint64_t max_bytes);
+// Evicts the cache when it goes out of scope, so a run bounds the cache on
+// every exit, not only on success. A null cache_dir disables it.
+class CacheEvictor {
+ private:
+    cstring cache_dir;
+    uint64_t max_bytes;
+
+ public:
+    CacheEvictor(cstring cache_dir, uint64_t max_bytes)
+        : cache_dir(cache_dir), max_bytes(max_bytes) {}
+    ~CacheEvictor() {
+        if (cache_dir != nullptr) {
+            evict_cache(cache_dir, max_bytes);
+        }
+    }
+    CacheEvictor(const CacheEvictor &) = delete;
+    CacheEvictor &operator=(const CacheEvictor &) = delete;
+};
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_COMPARE_CACHE_H_
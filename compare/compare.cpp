@@ -1,40 +1,74 @@
 #include "compare.h"
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+
+#include "boost/filesystem.hpp"
 
 #include "frontends/common/parseInput.h"
 
+#include "cache.h"
 #include "toz3/common/create_z3.h"
 #include "toz3/common/visitor_interpret.h"
 
 namespace TOZ3 {
 
-MainResult get_z3_repr(cstring prog_name, const IR::P4Program *program,
-                       z3::context *ctx) {
+namespace fs = boost::filesystem;
+
+// Interprets the program, the caller holds a P4CSection.
+static bool interpret_in_section(P4State *state,
+                                 const IR::P4Program *program,
+                                 MainResult *result, std::string *error) {
     try {
+        // Drop the instances of the previous program, keep the arena blocks.
+        state->reset();
         // Convert the P4 program to Z3
-        TOZ3::P4State state(ctx);
-        TOZ3::Z3Visitor to_z3(&state, false);
+        TOZ3::Z3Visitor to_z3(state, false);
         program->apply(to_z3);
-        const auto *decl = get_main_decl(&state);
+        const auto *decl = get_main_decl(state);
         if (decl == nullptr) {
-            return {};
+            *result = {};
+            return true;
         }
-        TOZ3::Z3Visitor to_z3_second(&state);
-        return gen_state_from_instance(&to_z3_second, decl);
+        TOZ3::Z3Visitor to_z3_second(state);
+        *result = gen_state_from_instance(&to_z3_second, decl);
+        auto num_instances = state->get_num_instances();
+        auto num_bytes = state->get_num_bytes();
+        Logger::log_msg(1, "Interpretation created %s instances in %s bytes.",
+                        num_instances, num_bytes);
     } catch (const Util::P4CExceptionBase &bug) {
-        std::cerr << "Failed to interpret pass \"" << prog_name << "\"."
-                  << std::endl;
-        std::cerr << bug.what() << std::endl;
-        exit(EXIT_FAILURE);
+        *error = bug.what();
+        return false;
     } catch (z3::exception &ex) {
-        std::cerr << "Failed to interpret pass \"" << prog_name << "\"."
-                  << std::endl;
-        std::cerr << "Z3 exception: " << ex << std::endl;
-        exit(EXIT_FAILURE);
+        *error = std::string("Z3 exception: ") + ex.msg();
+        return false;
     }
-    return {};
+    return true;
+}
+
+bool interpret_program(P4State *state, const IR::P4Program *program,
+                       MainResult *result, std::string *error) {
+    P4CSection section;
+    return interpret_in_section(state, program, result, error);
+}
+
+bool interpret_program(z3::context *ctx, const IR::P4Program *program,
+                       MainResult *result, std::string *error) {
+    P4State state(ctx);
+    return interpret_program(&state, program, result, error);
 }
 
 void unroll_result(const MainResult &z3_repr_prog,
@@ -49,62 +83,178 @@ void unroll_result(const MainResult &z3_repr_prog,
     }
 }
 
+bool add_z3_prog(P4State *state, cstring prog_name,
+                 const IR::P4Program *program, std::vector<Z3Prog> *z3_progs) {
+    MainResult z3_repr_prog;
+    std::string error;
+    std::vector<std::pair<cstring, z3::expr>> result_vec;
+    bool success = false;
+    {
+        // Unrolling the result creates the field names.
+        P4CSection section;
+        success =
+            interpret_in_section(state, program, &z3_repr_prog, &error);
+        if (success) {
+            unroll_result(z3_repr_prog, &result_vec);
+        }
+    }
+    if (!success) {
+        std::cerr << "Failed to interpret pass \"" << prog_name << "\"."
+                  << std::endl;
+        std::cerr << error << std::endl;
+        return false;
+    }
+    z3_progs->emplace_back(prog_name, result_vec);
+    z3_progs->back().undefined_vars = state->get_undefined_vars();
+    return true;
+}
+
+bool add_z3_prog(z3::context *ctx, cstring prog_name,
+                 const IR::P4Program *program, std::vector<Z3Prog> *z3_progs) {
+    P4State state(ctx);
+    return add_z3_prog(&state, prog_name, program, z3_progs);
+}
+
 z3::expr
 create_z3_struct(z3::context *ctx,
                  const std::vector<std::pair<cstring, z3::expr>> &z3_prog) {
     z3::expr_vector z3_vec(*ctx);
     std::vector<z3::sort> z3_vec_sorts;
+    std::vector<std::string> field_names;
     std::vector<const char *> names;
     z3::func_decl_vector getters(*ctx);
 
     for (const auto &prog_tuple : z3_prog) {
-        cstring before_name = "before" + prog_tuple.first;
-        names.push_back(before_name.c_str());
+        field_names.push_back(std::string("before") + prog_tuple.first.c_str());
         z3_vec.push_back(prog_tuple.second);
         z3_vec_sorts.push_back(prog_tuple.second.get_sort());
     }
+    for (const auto &field_name : field_names) {
+        names.push_back(field_name.c_str());
+    }
     auto before_sort = ctx->tuple_sort("State", z3_vec.size(), names.data(),
                                        z3_vec_sorts.data(), getters);
 
     return before_sort(z3_vec);
 }
 
-void print_violation_error(const z3::solver &s, const Z3Prog &prog_before,
-                           const Z3Prog &prog_after) {
-    std::cerr << "Found validation error.\n";
-    std::cerr << "Program " << prog_before.first << " before:\n";
+size_t strip_equal_fields(const Z3Prog &prog_before, const Z3Prog &prog_after,
+                          Z3Prog *diff_before, Z3Prog *diff_after) {
+    const auto &fields_before = prog_before.second;
+    const auto &fields_after = prog_after.second;
+    diff_before->first = prog_before.first;
+    diff_after->first = prog_after.first;
+    diff_before->undefined_vars = prog_before.undefined_vars;
+    diff_after->undefined_vars = prog_after.undefined_vars;
+    // Programs with a different layout can not be compared field by field.
+    if (fields_before.size() != fields_after.size()) {
+        diff_before->second = fields_before;
+        diff_after->second = fields_after;
+        return 0;
+    }
+    // Z3 hash-conses expressions within a context, so fields with the same
+    // AST are trivially equal and do not need to be checked by the solver.
+    size_t num_equal = 0;
+    for (size_t idx = 0; idx < fields_before.size(); ++idx) {
+        const auto &field_before = fields_before[idx];
+        const auto &field_after = fields_after[idx];
+        if (field_before.first == field_after.first &&
+            z3::eq(field_before.second, field_after.second)) {
+            num_equal++;
+            continue;
+        }
+        diff_before->second.push_back(field_before);
+        diff_after->second.push_back(field_after);
+    }
+    return num_equal;
+}
+
+z3::expr add_guarded(z3::context *ctx, z3::solver *s,
+                     const z3::expr &formula) {
+    // Guard the formula with a fresh activation literal instead of using
+    // push/pop. The solver then keeps its learned lemmas across checks.
+    auto act = z3::expr(
+        *ctx, Z3_mk_fresh_const(*ctx, ACTIVATION_LABEL, ctx->bool_sort()));
+    s->add(z3::implies(act, formula));
+    return act;
+}
+
+void set_timeout(z3::context *ctx, z3::solver *s, unsigned timeout) {
+    // A timeout of zero means no timeout.
+    if (timeout == 0) {
+        return;
+    }
+    z3::params p(*ctx);
+    p.set("timeout", timeout);
+    s->set(p);
+}
+
+std::string describe_violation(const z3::model &model,
+                               const Z3Prog &prog_before,
+                               const Z3Prog &prog_after) {
+    std::stringstream error;
+    error << "Found validation error.\n";
+    error << "Program " << prog_before.first << " before:\n";
     for (const auto &prog_tuple_before : prog_before.second) {
-        cstring left_name = prog_tuple_before.first + ": ";
-        std::cerr << std::left << std::setw(COLUMN_WIDTH) << left_name;
-        std::cerr << std::right << std::setw(COLUMN_WIDTH)
-                  << prog_tuple_before.second.simplify() << std::endl;
+        auto left_name = std::string(prog_tuple_before.first) + ": ";
+        error << std::left << std::setw(COLUMN_WIDTH) << left_name;
+        error << std::right << std::setw(COLUMN_WIDTH)
+              << prog_tuple_before.second.simplify() << std::endl;
     }
-    std::cerr << "\nProgram " << prog_after.first << " after:\n";
+    error << "\nProgram " << prog_after.first << " after:\n";
     for (const auto &prog_tuple_after : prog_after.second) {
-        cstring left_name = prog_tuple_after.first + ": ";
-        std::cerr << std::left << std::setw(COLUMN_WIDTH) << left_name;
-        std::cerr << std::right << std::setw(COLUMN_WIDTH)
-                  << prog_tuple_after.second.simplify() << std::endl;
+        auto left_name = std::string(prog_tuple_after.first) + ": ";
+        error << std::left << std::setw(COLUMN_WIDTH) << left_name;
+        error << std::right << std::setw(COLUMN_WIDTH)
+              << prog_tuple_after.second.simplify() << std::endl;
     }
-    auto model = s.get_model();
-    std::cerr << "\nSolution :\n";
+    error << "\nSolution :\n";
     for (size_t idx = 0; idx < model.size(); idx++) {
         auto var = model[idx];
-        std::cerr << var.name() << " = " << model.get_const_interp(var)
-                  << std::endl;
+        if (var.name().str().rfind(ACTIVATION_LABEL, 0) == 0) {
+            continue;
+        }
+        error << var.name() << " = " << model.get_const_interp(var)
+              << std::endl;
     }
+    return error.str();
 }
 
+// Orders expressions by their AST id.
+struct ExprIdLess {
+    bool operator()(const z3::expr &left, const z3::expr &right) const {
+        return left.id() < right.id();
+    }
+};
+using ExprSet = std::set<z3::expr, ExprIdLess>;
+
+struct TaintResult {
+    // Keep the input alive, its AST id is the key of the cache.
+    z3::expr input;
+    z3::expr output;
+    ExprSet taint_vars;
+};
+
+// Memoizes the taint substitution of a DAG of expressions.
+struct TaintCache {
+    std::map<unsigned, TaintResult> results;
+    // Declarations of the constants that hold an undefined value.
+    std::set<unsigned> undefined_decls;
+};
+
 z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
-                          std::set<z3::expr> *taint_vars) {
+                          ExprSet *taint_vars, TaintCache *cache);
+
+z3::expr substitute_taint_uncached(z3::context *ctx, const z3::expr &z3_var,
+                                   ExprSet *taint_vars, TaintCache *cache) {
     auto decl = z3_var.decl();
     auto z3_sort = z3_var.get_sort();
     if (decl.decl_kind() == Z3_OP_ITE) {
         auto cond_expr = z3_var.arg(0);
         auto then_expr = z3_var.arg(1);
         auto else_expr = z3_var.arg(2);
-        std::set<z3::expr> cond_taint_vars;
-        cond_expr = substitute_taint(ctx, cond_expr, &cond_taint_vars);
+        ExprSet cond_taint_vars;
+        cond_expr = substitute_taint(ctx, cond_expr, &cond_taint_vars, cache);
         // Check if the cond expr is an ite statement after substitution.
         // If the condition is tainted, do not even bother to evaluate the rest.
         if (cond_expr.decl().decl_kind() != Z3_OP_ITE &&
@@ -115,10 +265,10 @@ z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
             return taint_const;
         }
         // Evaluate the branches.
-        std::set<z3::expr> then_taint_vars;
-        then_expr = substitute_taint(ctx, then_expr, &then_taint_vars);
-        std::set<z3::expr> else_taint_vars;
-        else_expr = substitute_taint(ctx, else_expr, &else_taint_vars);
+        ExprSet then_taint_vars;
+        then_expr = substitute_taint(ctx, then_expr, &then_taint_vars, cache);
+        ExprSet else_taint_vars;
+        else_expr = substitute_taint(ctx, else_expr, &else_taint_vars, cache);
         // Check if the branches are an ite statement after substitution.
         if (then_expr.decl().decl_kind() != Z3_OP_ITE &&
             else_expr.decl().decl_kind() != Z3_OP_ITE &&
@@ -138,10 +288,8 @@ z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
         }
         return z3_var;
     }
-    if (z3_var.is_const() &&
-        z3_var.to_string().find("undefined") != std::string::npos) {
+    if (z3_var.is_const() && cache->undefined_decls.count(decl.id()) > 0) {
         // The expression is tainted replace it.
-        // Really dumb check, do not need anything else.
         auto taint_const =
             z3::expr(*ctx, Z3_mk_fresh_const(*ctx, "taint", z3_sort));
         taint_vars->insert(taint_const);
@@ -152,8 +300,8 @@ z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
     z3::expr_vector new_child_vars(*ctx);
     for (size_t idx = 0; idx < arg_num; ++idx) {
         auto child = z3_var.arg(idx);
-        std::set<z3::expr> child_taint_vars;
-        child = substitute_taint(ctx, child, &child_taint_vars);
+        ExprSet child_taint_vars;
+        child = substitute_taint(ctx, child, &child_taint_vars, cache);
         // Replace entire expression if one non-ite member is tainted.
         if (child.decl().decl_kind() != Z3_OP_ITE &&
             !child_taint_vars.empty()) {
@@ -173,107 +321,805 @@ z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
     return z3_var;
 }
 
-z3::check_result check_undefined(z3::context *ctx, z3::solver *s,
-                                 const z3::expr &z3_prog_before,
-                                 const z3::expr &z3_prog_after) {
-    auto arg_num = z3_prog_before.num_args();
-    s->reset();
-    for (size_t idx = 0; idx < arg_num; ++idx) {
-        s->push();
-        auto m_before = z3_prog_before.arg(idx).simplify();
-        auto m_after = z3_prog_after.arg(idx).simplify();
-        std::set<z3::expr> taint_vars;
-        m_before = substitute_taint(ctx, m_before, &taint_vars);
-        z3::expr tv_equiv = (m_before != m_after);
-        for (const auto &taint_var : taint_vars) {
-            if (m_before.get_sort().sort_kind() ==
-                taint_var.get_sort().sort_kind()) {
-                tv_equiv = tv_equiv && m_before != taint_var;
-            }
+z3::expr substitute_taint(z3::context *ctx, const z3::expr &z3_var,
+                          ExprSet *taint_vars, TaintCache *cache) {
+    // Shared sub-expressions of the DAG are only rewritten once.
+    auto it = cache->results.find(z3_var.id());
+    if (it == cache->results.end()) {
+        TaintResult result{z3_var, z3_var, {}};
+        result.output =
+            substitute_taint_uncached(ctx, z3_var, &result.taint_vars, cache);
+        it = cache->results.emplace(z3_var.id(), result).first;
+    }
+    const auto &taint_result = it->second;
+    taint_vars->insert(taint_result.taint_vars.begin(),
+                       taint_result.taint_vars.end());
+    return taint_result.output;
+}
+
+// The interpreter records the constants of undefined values when it creates
+// them, so they are looked up by the id of their declaration.
+void add_undefined_decls(const std::vector<z3::expr> &undefined_vars,
+                         TaintCache *cache) {
+    for (const auto &var : undefined_vars) {
+        cache->undefined_decls.insert(var.decl().id());
+    }
+}
+
+// The member differs in a value that is not caused by undefined behavior.
+// Every member gets its own cache. Otherwise a taint constant of a shared
+// sub-expression would tie unrelated members together.
+z3::expr create_member_miter(z3::context *ctx, const z3::expr &member_before,
+                             const z3::expr &member_after,
+                             const std::vector<z3::expr> &undefined_vars) {
+    auto m_before = member_before.simplify();
+    auto m_after = member_after.simplify();
+    TaintCache cache;
+    add_undefined_decls(undefined_vars, &cache);
+    ExprSet taint_vars;
+    m_before = substitute_taint(ctx, m_before, &taint_vars, &cache);
+    z3::expr tv_equiv = (m_before != m_after);
+    for (const auto &taint_var : taint_vars) {
+        if (m_before.get_sort().sort_kind() ==
+            taint_var.get_sort().sort_kind()) {
+            tv_equiv = tv_equiv && m_before != taint_var;
         }
-        // Check the equivalence of the modified clause.
-        Logger::log_msg(1, "Checking member %s... ", idx);
-        cstring equ = tv_equiv.to_string().c_str();
+    }
+    // Printing the equation is expensive, only do it if it is logged.
+    if (Logger::is_enabled(1)) {
+        auto equ = tv_equiv.to_string();
         Logger::log_msg(1, "Equation:\n%s", equ);
-        s->add(tv_equiv);
-        auto ret = s->check();
-        s->pop();
-        if (ret != z3::unsat) {
-            std::cerr << "Violation holds despite undefined behavior check.";
-            return ret;
+    }
+    return tv_equiv;
+}
+
+// Shared state of the workers that check the fields of a pass pair.
+struct FieldQueue {
+    const Z3Prog *prog_before;
+    const Z3Prog *prog_after;
+    unsigned timeout;
+    bool allow_undefined;
+    std::vector<z3::context *> worker_ctxs;
+    // The workers log like the thread that started them.
+    LogBuffer *log_buffer = nullptr;
+    // The source context is not thread-safe, only translate under this lock.
+    std::mutex source_mutex;
+    std::atomic<size_t> next_field{0};
+    std::atomic<bool> has_violation{false};
+    std::atomic<bool> has_unknown{false};
+    // The first violating field and its model in the worker context.
+    std::mutex violation_mutex;
+    size_t violation_field = 0;
+    std::unique_ptr<z3::model> violation_model;
+};
+
+void check_fields_worker(z3::context *worker_ctx, FieldQueue *queue) {
+    Logger::set_thread_buffer(queue->log_buffer);
+    const auto &fields_before = queue->prog_before->second;
+    const auto &fields_after = queue->prog_after->second;
+    z3::solver s(*worker_ctx);
+    set_timeout(worker_ctx, &s, queue->timeout);
+    try {
+        // The undefined constants are shared by all fields of the worker.
+        std::vector<z3::expr> undefined_vars;
+        if (queue->allow_undefined) {
+            std::lock_guard<std::mutex> lock(queue->source_mutex);
+            for (const auto &var : queue->prog_before->undefined_vars) {
+                undefined_vars.emplace_back(
+                    *worker_ctx, Z3_translate(var.ctx(), var, *worker_ctx));
+            }
         }
+        while (!queue->has_violation) {
+            size_t idx = queue->next_field++;
+            if (idx >= fields_before.size()) {
+                break;
+            }
+            z3::expr_vector members(*worker_ctx);
+            {
+                std::lock_guard<std::mutex> lock(queue->source_mutex);
+                const auto &src_before = fields_before[idx].second;
+                z3::expr_vector src_members(src_before.ctx());
+                src_members.push_back(src_before);
+                src_members.push_back(fields_after[idx].second);
+                members = z3::expr_vector(
+                    *worker_ctx,
+                    Z3_ast_vector_translate(src_before.ctx(), src_members,
+                                            *worker_ctx));
+            }
+            auto query = members[0] != members[1];
+            if (queue->allow_undefined) {
+                query = create_member_miter(worker_ctx, members[0], members[1],
+                                            undefined_vars);
+            }
+            auto act = add_guarded(worker_ctx, &s, query);
+            z3::expr_vector assumptions(*worker_ctx);
+            assumptions.push_back(act);
+            auto ret = s.check(assumptions);
+            if (ret == z3::sat) {
+                {
+                    std::lock_guard<std::mutex> lock(queue->violation_mutex);
+                    if (queue->violation_model == nullptr) {
+                        queue->violation_field = idx;
+                        queue->violation_model =
+                            std::make_unique<z3::model>(s.get_model());
+                    }
+                }
+                // Stop the other workers, one violation is enough.
+                queue->has_violation = true;
+                for (auto *other_ctx : queue->worker_ctxs) {
+                    other_ctx->interrupt();
+                }
+                break;
+            }
+            if (ret == z3::unknown) {
+                queue->has_unknown = true;
+            }
+            s.add(!act);
+        }
+    } catch (z3::exception &) {
+        queue->has_unknown = true;
     }
-    std::cerr << "Violation was caused by undefined behavior." << std::endl;
-    return z3::check_result::unsat;
 }
 
-int compare_progs(z3::context *ctx, const std::vector<Z3Prog> &z3_progs,
-                  bool allow_undefined) {
-    z3::solver s(*ctx);
-    auto prog_before = z3_progs[0];
-    auto z3_prog_before = create_z3_struct(ctx, prog_before.second);
-    for (size_t i = 1; i < z3_progs.size(); ++i) {
-        Logger::log_msg(1, "\nComparing %s and %s.", prog_before.first,
-                        z3_progs[i].first);
-        auto prog_after = z3_progs[i];
-        auto z3_prog_after = create_z3_struct(ctx, z3_progs[i].second);
-
-        s.push();
-        s.add(z3_prog_before != z3_prog_after);
-        Logger::log_msg(1, "Checking... ");
+// Returns sat with the model of the first violating field, translated into
+// ctx.
+z3::check_result check_fields_parallel(z3::context *ctx,
+                                       const Z3Prog &prog_before,
+                                       const Z3Prog &prog_after,
+                                       const CompareConfig &config,
+                                       z3::model *model) {
+    // Every worker owns a context, the queries are translated into it. The
+    // contexts outlive the queue, which holds the model of a violation.
+    std::vector<std::unique_ptr<z3::context>> worker_ctxs;
+    FieldQueue queue;
+    queue.prog_before = &prog_before;
+    queue.prog_after = &prog_after;
+    queue.timeout = config.solver_timeout;
+    queue.allow_undefined = config.allow_undefined;
+    queue.log_buffer = Logger::get_thread_buffer();
+    auto num_threads =
+        std::min(config.solver_threads, prog_before.second.size());
+    for (size_t idx = 0; idx < num_threads; ++idx) {
+        worker_ctxs.emplace_back(new z3::context());
+        queue.worker_ctxs.push_back(worker_ctxs.back().get());
+    }
+    std::vector<std::thread> workers;
+    for (auto *worker_ctx : queue.worker_ctxs) {
+        workers.emplace_back(check_fields_worker, worker_ctx, &queue);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (queue.has_violation) {
+        Logger::log_msg(1, "Field %s differs.",
+                        prog_before.second[queue.violation_field].first);
+        // The worker context is released on return.
+        *model = z3::model(*queue.violation_model, *ctx,
+                           z3::model::translate());
+        return z3::sat;
+    }
+    if (queue.has_unknown) {
+        return z3::unknown;
+    }
+    return z3::unsat;
+}
+
+// How often the winner of a portfolio interrupts the remaining solvers.
+static constexpr auto PORTFOLIO_INTERRUPT_INTERVAL =
+    std::chrono::milliseconds(1);
+
+bool parse_solver_portfolio(cstring arg,
+                            std::vector<SolverConfig> *portfolio) {
+    static const std::map<std::string, SolverConfig> config_names = {
+        {"default", SolverConfig::DEFAULT},
+        {"qfbv-tactic", SolverConfig::QF_BV_TACTIC},
+        {"qfbv", SolverConfig::QF_BV},
+    };
+    portfolio->clear();
+    std::stringstream arg_str(arg.c_str());
+    std::string name;
+    while (std::getline(arg_str, name, ',')) {
+        auto it = config_names.find(name);
+        if (it == config_names.end()) {
+            ::error("Unknown solver configuration: %s", name);
+            return false;
+        }
+        portfolio->push_back(it->second);
+    }
+    if (portfolio->empty()) {
+        ::error("The solver portfolio is empty.");
+        return false;
+    }
+    return true;
+}
+
+z3::solver make_portfolio_solver(z3::context *ctx, SolverConfig config) {
+    switch (config) {
+    case SolverConfig::QF_BV_TACTIC: {
+        // Tactic chain for the pure bit-vector queries we usually produce.
+        auto qf_bv = z3::tactic(*ctx, "simplify") &
+                     z3::tactic(*ctx, "propagate-values") &
+                     z3::tactic(*ctx, "solve-eqs") &
+                     z3::tactic(*ctx, "bit-blast") & z3::tactic(*ctx, "sat");
+        return qf_bv.mk_solver();
+    }
+    case SolverConfig::QF_BV:
+        return z3::solver(*ctx, "QF_BV");
+    case SolverConfig::DEFAULT:
+        break;
+    }
+    return z3::solver(*ctx);
+}
+
+// Shared state of the solver configurations racing in the portfolio.
+struct PortfolioRace {
+    std::vector<SolverConfig> configs;
+    // Creating a context is expensive, so they are reused for every query.
+    std::vector<std::unique_ptr<z3::context>> worker_ctxs;
+    std::vector<z3::expr> queries;
+    std::vector<z3::model> models;
+    // An interrupt only reaches a solver that is already inside check(), so
+    // every solver also tests its flag before it starts.
+    std::unique_ptr<std::atomic<bool>[]> cancelled;
+    // Set once a solver has returned, whatever its answer.
+    std::unique_ptr<std::atomic<bool>[]> finished;
+    unsigned timeout;
+    std::mutex result_mutex;
+    int64_t winner = -1;
+    z3::check_result result = z3::unknown;
+
+    size_t size() const { return configs.size(); }
+    // Sets the race up for a new portfolio, the contexts are kept as long as
+    // the portfolio stays the same.
+    void reset(const std::vector<SolverConfig> &portfolio) {
+        if (portfolio != configs) {
+            configs = portfolio;
+            worker_ctxs.clear();
+            for (size_t idx = 0; idx < size(); ++idx) {
+                worker_ctxs.emplace_back(new z3::context());
+            }
+            cancelled.reset(new std::atomic<bool>[size()]);
+            finished.reset(new std::atomic<bool>[size()]);
+        }
+        for (size_t idx = 0; idx < size(); ++idx) {
+            cancelled[idx] = false;
+            finished[idx] = false;
+        }
+        winner = -1;
+        result = z3::unknown;
+    }
+};
+
+// Returns true if this solver gave the first definite answer.
+static bool race_portfolio_solver(size_t solver_idx, PortfolioRace *race) {
+    auto *worker_ctx = race->worker_ctxs[solver_idx].get();
+    try {
+        auto s = make_portfolio_solver(worker_ctx, race->configs[solver_idx]);
+        set_timeout(worker_ctx, &s, race->timeout);
+        s.add(race->queries[solver_idx]);
+        if (race->cancelled[solver_idx]) {
+            return false;
+        }
         auto ret = s.check();
-        Logger::log_msg(1, "Result: %s", ret);
+        std::lock_guard<std::mutex> lock(race->result_mutex);
+        if (ret == z3::unknown || race->winner >= 0) {
+            return false;
+        }
+        race->winner = solver_idx;
+        race->result = ret;
         if (ret == z3::sat) {
-            s.pop();
-            std::cerr << "Programs are not equal!" << std::endl;
-            if (allow_undefined) {
-                std::cerr << "Rechecking whether violation is caused by "
-                             "undefined behavior."
-                          << std::endl;
-                ret = check_undefined(ctx, &s, z3_prog_before, z3_prog_after);
-                if (ret != z3::unsat) {
-                    print_violation_error(s, prog_before, prog_after);
-                    return EXIT_VIOLATION;
-                }
-                prog_before = prog_after;
-                z3_prog_before = z3_prog_after;
-                continue;
+            race->models[solver_idx] = s.get_model();
+        }
+        for (size_t idx = 0; idx < race->size(); ++idx) {
+            race->cancelled[idx] = idx != solver_idx;
+        }
+        return true;
+    } catch (z3::exception &) {
+        // Configurations that do not support the query drop out.
+    }
+    return false;
+}
+
+void run_portfolio_solver(size_t solver_idx, PortfolioRace *race) {
+    bool won = race_portfolio_solver(solver_idx, race);
+    race->finished[solver_idx] = true;
+    if (!won) {
+        return;
+    }
+    // A solver may pass its flag just before the winner sets it, and then
+    // misses an interrupt sent before it enters check(). So the winner
+    // keeps interrupting every other solver until it has returned.
+    for (size_t idx = 0; idx < race->size(); ++idx) {
+        while (!race->finished[idx]) {
+            race->worker_ctxs[idx]->interrupt();
+            std::this_thread::sleep_for(PORTFOLIO_INTERRUPT_INTERVAL);
+        }
+    }
+}
+
+z3::check_result check_portfolio(z3::context *ctx, const z3::expr &query,
+                                 const std::vector<SolverConfig> &portfolio,
+                                 unsigned timeout, z3::model *model) {
+    // Every thread races in contexts of its own.
+    thread_local PortfolioRace race;
+    race.reset(portfolio);
+    race.timeout = timeout;
+    // Every solver runs in its own context, translate the query up front.
+    for (size_t idx = 0; idx < race.size(); ++idx) {
+        auto *worker_ctx = race.worker_ctxs[idx].get();
+        race.queries.emplace_back(
+            *worker_ctx, Z3_translate(*ctx, query, *worker_ctx));
+        race.models.emplace_back(*worker_ctx);
+    }
+    std::vector<std::thread> workers;
+    for (size_t idx = 0; idx < race.size(); ++idx) {
+        workers.emplace_back(run_portfolio_solver, idx, &race);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto ret = race.result;
+    if (ret == z3::sat) {
+        *model = z3::model(race.models[race.winner], *ctx,
+                           z3::model::translate());
+    }
+    // Release the expressions of this query, the contexts stay.
+    race.queries.clear();
+    race.models.clear();
+    return ret;
+}
+
+z3::check_result check_query(z3::context *ctx, z3::solver *s,
+                             const z3::expr &query, const CompareConfig &config,
+                             z3::model *model) {
+    auto timeout = config.solver_timeout;
+    auto ret = z3::unknown;
+    // The same query may have been solved for other programs or runs.
+    uint64_t cache_key = 0;
+    if (config.cache_dir != nullptr) {
+        cache_key = get_query_cache_key(query);
+        if (load_check_result(ctx, config.cache_dir, cache_key, &ret, model)) {
+            Logger::log_msg(1, "Loaded the query result from the cache.");
+            return ret;
+        }
+    }
+    // Queries that time out are retried with an escalating timeout.
+    for (size_t round = 0; round < config.timeout_rounds; ++round) {
+        if (!config.portfolio.empty()) {
+            ret = check_portfolio(ctx, query, config.portfolio, timeout,
+                                  model);
+        } else {
+            set_timeout(ctx, s, timeout);
+            auto act = add_guarded(ctx, s, query);
+            z3::expr_vector assumptions(*ctx);
+            assumptions.push_back(act);
+            ret = s->check(assumptions);
+            if (ret == z3::sat) {
+                *model = s->get_model();
             }
-            print_violation_error(s, prog_before, prog_after);
-            return EXIT_VIOLATION;
+            // Retire the literal, the clause is never needed again.
+            s->add(!act);
         }
-        if (ret == z3::unknown) {
-            std::cerr << "Error: Could not determine equality. Error"
-                      << std::endl;
-            return EXIT_FAILURE;
+        if (ret != z3::unknown || timeout == 0) {
+            break;
         }
-        s.pop();
-        prog_before = prog_after;
-        z3_prog_before = z3_prog_after;
+        timeout *= 2;
+        Logger::log_msg(1, "Query timed out, retrying with %s ms.", timeout);
+    }
+    if (config.cache_dir != nullptr) {
+        store_check_result(ctx, config.cache_dir, cache_key, ret, *model);
+    }
+    return ret;
+}
+
+z3::expr create_undefined_miter(z3::context *ctx,
+                                const z3::expr &z3_prog_before,
+                                const z3::expr &z3_prog_after,
+                                const std::vector<z3::expr> &undefined_vars) {
+    // The programs only differ if a member differs in a value that is not
+    // caused by undefined behavior. All members are encoded in one query.
+    auto miter = ctx->bool_val(false);
+    auto arg_num = z3_prog_before.num_args();
+    for (size_t idx = 0; idx < arg_num; ++idx) {
+        Logger::log_msg(1, "Member %s... ", idx);
+        miter = miter || create_member_miter(ctx, z3_prog_before.arg(idx),
+                                             z3_prog_after.arg(idx),
+                                             undefined_vars);
+    }
+    return miter;
+}
+
+CompareResult compare_pair(z3::context *ctx, z3::solver *s,
+                           const Z3Prog &prog_before, const Z3Prog &prog_after,
+                           const CompareConfig &config) {
+    CompareResult result;
+    // Only pass the fields that are not structurally equal to the solver.
+    Z3Prog diff_before;
+    Z3Prog diff_after;
+    auto num_equal = strip_equal_fields(prog_before, prog_after, &diff_before,
+                                        &diff_after);
+    result.structural_fields = num_equal;
+    Logger::log_msg(1, "%s fields are structurally equal.", num_equal);
+    if (diff_before.second.empty() && diff_after.second.empty()) {
+        return result;
+    }
+    result.solver_fields = diff_before.second.size();
+    // Split the query by output field and check the fields in parallel.
+    // The fields of every pipe are already separate, a per-pipe split would
+    // only group them again.
+    z3::model model(*ctx);
+    auto ret = z3::unknown;
+    if (config.solver_threads > 1 &&
+        diff_before.second.size() == diff_after.second.size()) {
+        ret = check_fields_parallel(ctx, diff_before, diff_after, config,
+                                    &model);
+        Logger::log_msg(1, "Parallel result: %s", ret);
+        if (ret == z3::unsat) {
+            return result;
+        }
+    }
+    // Only fall through to the full query if a field was undecided.
+    if (ret == z3::unknown) {
+        auto z3_prog_before = create_z3_struct(ctx, diff_before.second);
+        auto z3_prog_after = create_z3_struct(ctx, diff_after.second);
+
+        auto query = z3_prog_before != z3_prog_after;
+        if (config.allow_undefined) {
+            query = create_undefined_miter(ctx, z3_prog_before, z3_prog_after,
+                                           prog_before.undefined_vars);
+        }
+        Logger::log_msg(1, "Checking... ");
+        ret = check_query(ctx, s, query, config, &model);
+        Logger::log_msg(1, "Result: %s", ret);
+    }
+    if (ret == z3::sat) {
+        result.exit_code = EXIT_VIOLATION;
+        result.error = "Programs are not equal!";
+        if (config.allow_undefined) {
+            result.error += "\nViolation holds despite undefined behavior.";
+        }
+        result.counterexample =
+            describe_violation(model, prog_before, prog_after);
+    } else if (ret == z3::unknown) {
+        result.exit_code = EXIT_FAILURE;
+        result.error = "Error: Could not determine equality. Error";
+    }
+    return result;
+}
+
+CompareResult compare_programs(z3::context *ctx,
+                               const std::vector<Z3Prog> &z3_progs,
+                               const CompareConfig &config) {
+    CompareResult result;
+    if (z3_progs.empty()) {
+        result.exit_code = EXIT_FAILURE;
+        result.error = "No programs to compare.";
+        return result;
+    }
+    try {
+        z3::solver s(*ctx);
+        for (size_t i = 1; i < z3_progs.size(); ++i) {
+            const auto &prog_before = z3_progs[i - 1];
+            const auto &prog_after = z3_progs[i];
+            Logger::log_msg(1, "\nComparing %s and %s.", prog_before.first,
+                            prog_after.first);
+            auto pair_result =
+                compare_pair(ctx, &s, prog_before, prog_after, config);
+            result.structural_fields += pair_result.structural_fields;
+            result.solver_fields += pair_result.solver_fields;
+            if (pair_result.exit_code != EXIT_SUCCESS) {
+                result.exit_code = pair_result.exit_code;
+                result.error = pair_result.error;
+                result.counterexample = pair_result.counterexample;
+                result.prog_before = prog_before.first;
+                result.prog_after = prog_after.first;
+                return result;
+            }
+        }
+    } catch (z3::exception &ex) {
+        result.exit_code = EXIT_FAILURE;
+        result.error = std::string("Z3 exception: ") + ex.msg();
+    }
+    return result;
+}
+
+int report_result(const CompareResult &result) {
+    if (result.exit_code != EXIT_SUCCESS) {
+        std::cerr << result.error << std::endl;
+        std::cerr << result.counterexample;
+        return result.exit_code;
     }
     Logger::log_msg(0, "Passed all checks.");
+    Logger::log_msg(0, "Fields checked structurally: %s, by the solver: %s.",
+                    result.structural_fields, result.solver_fields);
     return EXIT_SUCCESS;
 }
 
-int process_programs(const std::vector<cstring> &prog_list,
-                     ParserOptions *options, bool allow_undefined) {
-    z3::context ctx;
-    // Parse the first program
-    // Use a little trick here to get the second program
-    std::vector<Z3Prog> z3_progs;
-    for (auto prog : prog_list) {
-        options->file = prog;
-        const auto *prog_parsed = P4::parseP4File(*options);
-        if (prog_parsed == nullptr || ::errorCount() > 0) {
+int compare_progs(z3::context *ctx, const std::vector<Z3Prog> &z3_progs,
+                  const CompareConfig &config) {
+    return report_result(compare_programs(ctx, z3_progs, config));
+}
+
+Z3Prog translate_prog(const Z3Prog &prog, z3::context *dst_ctx) {
+    Z3Prog translated{prog.first, {}};
+    if (prog.second.empty()) {
+        return translated;
+    }
+    // Translate all fields at once, so shared sub-expressions stay shared.
+    // The undefined constants follow the fields.
+    auto &src_ctx = prog.second.front().second.ctx();
+    z3::expr_vector src_exprs(src_ctx);
+    for (const auto &field : prog.second) {
+        src_exprs.push_back(field.second);
+    }
+    for (const auto &var : prog.undefined_vars) {
+        src_exprs.push_back(var);
+    }
+    z3::expr_vector dst_exprs(
+        *dst_ctx, Z3_ast_vector_translate(src_ctx, src_exprs, *dst_ctx));
+    auto num_fields = prog.second.size();
+    for (size_t idx = 0; idx < num_fields; ++idx) {
+        translated.second.emplace_back(prog.second[idx].first,
+                                       dst_exprs[idx]);
+    }
+    for (size_t idx = num_fields; idx < dst_exprs.size(); ++idx) {
+        translated.undefined_vars.push_back(dst_exprs[idx]);
+    }
+    return translated;
+}
+
+std::vector<cstring> split_input_progs(cstring input_progs) {
+    std::vector<cstring> prog_list;
+    const char *pos = nullptr;
+    cstring prog;
+
+    while ((pos = input_progs.find((size_t)',')) != nullptr) {
+        auto idx = (size_t)(pos - input_progs);
+        prog = input_progs.substr(0, idx);
+        prog_list.push_back(prog);
+        input_progs = input_progs.substr(idx + 1);
+    }
+    prog_list.push_back(input_progs);
+    return prog_list;
+}
+
+// Programs with a known source hash are keyed without the preprocessor, as
+// are all programs if the config asks for it.
+static bool get_program_cache_key(ParserOptions *options,
+                                  const CompareConfig &config, uint64_t *key) {
+    const uint64_t *source_hash = nullptr;
+    if (config.source_hashes != nullptr) {
+        auto it = config.source_hashes->find(options->file);
+        if (it != config.source_hashes->end()) {
+            source_hash = &it->second;
+        }
+    }
+    if ((source_hash != nullptr || config.key_by_source) &&
+        get_source_cache_key(options, source_hash, key)) {
+        return true;
+    }
+    return get_repr_cache_key(options, key);
+}
+
+// Parses and interprets a program, unless one of the caches has it.
+bool load_program(cstring prog, ParserOptions *options,
+                  const CompareConfig &config, P4State *state,
+                  ReprMap *reprs, Z3Prog *result) {
+    auto *ctx = state->get_z3_ctx();
+    options->file = prog;
+    result->first = prog;
+    // Reuse the representation of programs we have already interpreted.
+    uint64_t cache_key = 0;
+    bool use_disk = config.cache_dir != nullptr;
+    bool has_key = (use_disk || reprs != nullptr) &&
+                   get_program_cache_key(options, config, &cache_key);
+    if (has_key && reprs != nullptr && reprs->count(cache_key) > 0) {
+        Logger::log_msg(1, "Reusing %s from this context.", prog);
+        *result = reprs->at(cache_key);
+        result->first = prog;
+        return true;
+    }
+    if (has_key && use_disk &&
+        load_z3_repr(ctx, config.cache_dir, cache_key, &result->second,
+                     &result->undefined_vars)) {
+        Logger::log_msg(1, "Loaded %s from the cache.", prog);
+    } else {
+        const IR::P4Program *prog_parsed = nullptr;
+        bool has_errors = false;
+        {
+            P4CSection section;
+            prog_parsed = P4::parseP4File(*options);
+            has_errors = ::errorCount() > 0;
+        }
+        if (prog_parsed == nullptr || has_errors) {
             std::cerr << "Unable to parse program." << std::endl;
+            return false;
+        }
+        std::vector<Z3Prog> parsed_progs;
+        if (!add_z3_prog(state, prog, prog_parsed, &parsed_progs)) {
+            return false;
+        }
+        *result = parsed_progs.back();
+        if (has_key && use_disk) {
+            store_z3_repr(ctx, config.cache_dir, cache_key, result->second,
+                          result->undefined_vars);
+        }
+    }
+    if (has_key && reprs != nullptr) {
+        reprs->emplace(cache_key, *result);
+    }
+    return true;
+}
+
+// A forked child only runs the calling thread. Locks that other threads held
+// at the time stay locked in the child, so only fork without them.
+static bool is_single_threaded() {
+    boost::system::error_code ec;
+    fs::directory_iterator task_it("/proc/self/task", ec);
+    if (ec) {
+        return false;
+    }
+    return std::distance(task_it, fs::directory_iterator()) == 1;
+}
+
+// Interprets the programs in forked workers with their own context. Each
+// worker writes its results as SMT-LIB2, which is parsed into ctx.
+bool interpret_parallel(const std::vector<cstring> &prog_list,
+                        ParserOptions *options, const CompareConfig &config,
+                        z3::context *ctx, std::vector<Z3Prog> *results) {
+    boost::system::error_code ec;
+    auto tmp_dir = fs::temp_directory_path(ec) /
+                   fs::unique_path("toz3-%%%%%%%%", ec);
+    if (!ec) {
+        fs::create_directories(tmp_dir, ec);
+    }
+    if (ec) {
+        std::cerr << "Unable to create a temporary folder: " << ec.message()
+                  << std::endl;
+        return false;
+    }
+    auto num_workers = std::min(config.interpret_jobs, prog_list.size());
+    Logger::log_msg(1, "Interpreting with %s workers.", num_workers);
+    // Do not duplicate buffered output in the workers.
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> workers;
+    for (size_t worker_idx = 0; worker_idx < num_workers; ++worker_idx) {
+        auto pid = fork();
+        if (pid < 0) {
+            break;
+        }
+        if (pid == 0) {
+            z3::context worker_ctx;
+            P4State worker_state(&worker_ctx);
+            int status = EXIT_SUCCESS;
+            for (size_t idx = worker_idx; idx < prog_list.size();
+                 idx += num_workers) {
+                Z3Prog result;
+                if (!load_program(prog_list[idx], options, config,
+                                  &worker_state, nullptr, &result)) {
+                    status = EXIT_FAILURE;
+                    break;
+                }
+                auto repr_path = tmp_dir / (std::to_string(idx) + ".smt2");
+                write_z3_repr(&worker_ctx, repr_path.string(), result.second,
+                              result.undefined_vars);
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(status);
+        }
+        workers.push_back(pid);
+    }
+    bool success = workers.size() == num_workers;
+    for (auto pid : workers) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS) {
+            success = false;
+        }
+    }
+    for (size_t idx = 0; success && idx < prog_list.size(); ++idx) {
+        auto repr_path = tmp_dir / (std::to_string(idx) + ".smt2");
+        auto *result = &results->at(idx);
+        result->first = prog_list[idx];
+        success = read_z3_repr(ctx, repr_path.string(), &result->second,
+                               &result->undefined_vars);
+    }
+    fs::remove_all(tmp_dir, ec);
+    return success;
+}
+
+CompareResult compare_program_list(const std::vector<cstring> &prog_list,
+                                   ParserOptions *options,
+                                   const CompareConfig &config,
+                                   P4State *state, ReprMap *reprs) {
+    auto *ctx = state->get_z3_ctx();
+    CacheEvictor evictor(config.cache_dir, config.cache_size);
+    CompareResult result;
+    std::vector<Z3Prog> results(prog_list.size());
+    // The warm context of the server keeps its programs in this process.
+    bool use_workers =
+        config.interpret_jobs > 1 && prog_list.size() > 1 && reprs == nullptr;
+    if (use_workers && !is_single_threaded()) {
+        Logger::log_msg(0, "Other threads are running, interpreting the "
+                           "programs in this process.");
+        use_workers = false;
+    }
+    if (use_workers) {
+        if (!interpret_parallel(prog_list, options, config, ctx, &results)) {
+            result.exit_code = EXIT_FAILURE;
+            result.error = "Failed to interpret the programs.";
+            return result;
+        }
+    } else {
+        for (size_t idx = 0; idx < prog_list.size(); ++idx) {
+            if (!load_program(prog_list[idx], options, config, state, reprs,
+                              &results[idx])) {
+                result.exit_code = EXIT_FAILURE;
+                result.error = std::string("Failed to load ") +
+                               prog_list[idx].c_str() + ".";
+                return result;
+            }
+        }
+    }
+    return compare_programs(ctx, results, config);
+}
+
+int process_programs(const std::vector<cstring> &prog_list,
+                     ParserOptions *options, const CompareConfig &config,
+                     P4State *state, ReprMap *reprs) {
+    return report_result(
+        compare_program_list(prog_list, options, config, state, reprs));
+}
+
+// Compares every program against its predecessor right after interpreting
+// it. Each pair gets a fresh context, the older program is translated into
+// it, so Z3 releases everything else once the previous context is gone.
+int process_programs_streaming(const std::vector<cstring> &prog_list,
+                               ParserOptions *options,
+                               const CompareConfig &config) {
+    CacheEvictor evictor(config.cache_dir, config.cache_size);
+    auto ctx = std::make_unique<z3::context>();
+    // The state moves along with the context and keeps its arena blocks.
+    P4State state(ctx.get());
+    Z3Prog prog_before;
+    if (!load_program(prog_list.front(), options, config, &state, nullptr,
+                      &prog_before)) {
+        return EXIT_FAILURE;
+    }
+    CompareResult result;
+    for (size_t idx = 1; idx < prog_list.size(); ++idx) {
+        auto next_ctx = std::make_unique<z3::context>();
+        // Release the expressions of the old context before deleting it.
+        prog_before = translate_prog(prog_before, next_ctx.get());
+        state.reset(next_ctx.get());
+        ctx = std::move(next_ctx);
+        Z3Prog prog_after;
+        if (!load_program(prog_list[idx], options, config, &state, nullptr,
+                          &prog_after)) {
             return EXIT_FAILURE;
         }
-        auto z3_repr_prog = get_z3_repr(prog, prog_parsed, &ctx);
-        std::vector<std::pair<cstring, z3::expr>> result_vec;
-        unroll_result(z3_repr_prog, &result_vec);
-        z3_progs.emplace_back(prog, result_vec);
+        auto pair_result =
+            compare_programs(ctx.get(), {prog_before, prog_after}, config);
+        result.structural_fields += pair_result.structural_fields;
+        result.solver_fields += pair_result.solver_fields;
+        if (pair_result.exit_code != EXIT_SUCCESS) {
+            return report_result(pair_result);
+        }
+        prog_before = prog_after;
+    }
+    return report_result(result);
+}
+
+int process_programs(const std::vector<cstring> &prog_list,
+                     ParserOptions *options, const CompareConfig &config) {
+    if (config.stream && !prog_list.empty()) {
+        return process_programs_streaming(prog_list, options, config);
     }
-    return compare_progs(&ctx, z3_progs, allow_undefined);
+    z3::context ctx;
+    P4State state(&ctx);
+    return process_programs(prog_list, options, config, &state, nullptr);
 }
 
 }  // namespace TOZ3
@@ -1,18 +1,148 @@
 #ifndef TOZ3_COMPARE_COMPARE_H_
 #define TOZ3_COMPARE_COMPARE_H_
 
+#include <cstdlib>
+#include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "../contrib/z3/z3++.h"
+#include "frontends/common/options.h"
 #include "ir/ir.h"
-#include "options.h"
+
+#include "toz3/common/type_base.h"
 
 namespace TOZ3 {
-using Z3Prog = std::pair<cstring, std::vector<std::pair<cstring, z3::expr>>>;
+class P4State;
+// The name of a program and its output fields.
+struct Z3Prog
+    : std::pair<cstring, std::vector<std::pair<cstring, z3::expr>>> {
+    using pair::pair;
+    Z3Prog() = default;
+    // Constants that stand for undefined values in the fields, as recorded by
+    // the interpreter.
+    std::vector<z3::expr> undefined_vars;
+};
 constexpr auto COLUMN_WIDTH = 40;
+constexpr auto ACTIVATION_LABEL = "activate";
+// Solver configurations that can race in the portfolio.
+enum class SolverConfig {
+    // The default SMT core.
+    DEFAULT,
+    // A bit-blasting tactic chain for pure bit-vector queries.
+    QF_BV_TACTIC,
+    // The solver for the QF_BV logic.
+    QF_BV,
+};
+// Parses a comma-separated list of the configurations default, qfbv-tactic
+// and qfbv. Reports an error and returns false for unknown names.
+bool parse_solver_portfolio(cstring arg, std::vector<SolverConfig> *portfolio);
+// Settings for the equivalence check of a list of programs.
+struct CompareConfig {
+    // Toggle this to allow differences in undefined behavior.
+    bool allow_undefined = false;
+    // Number of threads which check the output fields of a pass pair.
+    // Values below two check each pass pair with a single query.
+    size_t solver_threads = 0;
+    // Timeout of a single query in milliseconds, zero disables it.
+    unsigned solver_timeout = 0;
+    // Race these solver configurations and take the first answer. An empty
+    // portfolio checks the queries with a single solver.
+    std::vector<SolverConfig> portfolio;
+    // How often a query is tried when it times out, the timeout doubles
+    // every round.
+    size_t timeout_rounds = 3;
+    // Cache folder for the Z3 representation of programs, if any.
+    cstring cache_dir = nullptr;
+    // Size limit of the cache folder in bytes.
+    uint64_t cache_size = 0;
+    // Hashes of the program sources the caller already computed, keyed by
+    // path. The cache key of these programs skips the preprocessor.
+    const std::map<cstring, uint64_t> *source_hashes = nullptr;
+    // Key all programs by their source and includes instead.
+    bool key_by_source = false;
+    // Number of worker processes which interpret the programs.
+    // Values below two interpret them in this process.
+    size_t interpret_jobs = 0;
+    // Compare each program as soon as it is interpreted and keep only two
+    // programs in memory.
+    bool stream = false;
+};
+// Outcome of a comparison. The library never exits the process, failures
+// are reported here instead.
+struct CompareResult {
+    // EXIT_SUCCESS, EXIT_VIOLATION or EXIT_FAILURE.
+    int exit_code = EXIT_SUCCESS;
+    // Why the comparison failed, empty otherwise.
+    std::string error;
+    // The pair of programs that are not equivalent.
+    cstring prog_before = nullptr;
+    cstring prog_after = nullptr;
+    // Both programs and the input that distinguishes them.
+    std::string counterexample;
+    // How many output fields were equal by structure or by the solver.
+    size_t structural_fields = 0;
+    size_t solver_fields = 0;
+};
+
+// Both functions may be called from several threads, as long as every
+// thread uses its own z3::context. Comparing programs runs concurrently, but
+// interpretation does not: it interns strings and creates IR nodes in the
+// process-global tables of P4C, so it holds a P4CSection and only one thread
+// interprets at a time. Use the interpreter workers of CompareConfig to
+// interpret on several cores.
+
+// Interprets a parsed program. On failure it returns false and describes
+// the failure in error.
+bool interpret_program(z3::context *ctx, const IR::P4Program *program,
+                       MainResult *result, std::string *error);
+// Like above, but reuses a state of the calling thread, which is reset first.
+// The result stays valid until the state is reset again.
+bool interpret_program(P4State *state, const IR::P4Program *program,
+                       MainResult *result, std::string *error);
+// Checks each program of the list against its predecessor.
+CompareResult compare_programs(z3::context *ctx,
+                               const std::vector<Z3Prog> &z3_progs,
+                               const CompareConfig &config);
+
+// Interpreted programs of one context, keyed by the hash of the preprocessed
+// program.
+using ReprMap = std::map<uint64_t, Z3Prog>;
+// Splits a comma-separated list of programs.
+std::vector<cstring> split_input_progs(cstring input_progs);
+int process_programs(const std::vector<cstring> &prog_list,
+                     ParserOptions *options, const CompareConfig &config);
+// Compares the programs in the context of an existing state, which is reused
+// for every program. Programs found in reprs are not interpreted again, new
+// programs are added to it. reprs may be null.
 int process_programs(const std::vector<cstring> &prog_list,
-                     ParserOptions *options, bool allow_undefined = false);
+                     ParserOptions *options, const CompareConfig &config,
+                     P4State *state, ReprMap *reprs);
+// Like above, but returns the result instead of printing it.
+CompareResult compare_program_list(const std::vector<cstring> &prog_list,
+                                   ParserOptions *options,
+                                   const CompareConfig &config,
+                                   P4State *state, ReprMap *reprs);
+// Parses and interprets a program file in the context of the state, unless
+// one of the caches has it.
+bool load_program(cstring prog, ParserOptions *options,
+                  const CompareConfig &config, P4State *state,
+                  ReprMap *reprs, Z3Prog *result);
+// Interprets a parsed program and appends its representation to z3_progs.
+// Prints the failure and returns false if the program cannot be interpreted.
+bool add_z3_prog(P4State *state, cstring prog_name,
+                 const IR::P4Program *program, std::vector<Z3Prog> *z3_progs);
+// Like above, but with a state of its own.
+bool add_z3_prog(z3::context *ctx, cstring prog_name,
+                 const IR::P4Program *program, std::vector<Z3Prog> *z3_progs);
+// Prints the result of compare_programs and returns its exit code.
+int report_result(const CompareResult &result);
+// Like compare_programs, but prints the result and returns the exit code.
+int compare_progs(z3::context *ctx, const std::vector<Z3Prog> &z3_progs,
+                  const CompareConfig &config);
+// Copies the representation of a program into another context.
+Z3Prog translate_prog(const Z3Prog &prog, z3::context *dst_ctx);
 
 }  // namespace TOZ3
 
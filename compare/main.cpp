@@ -2,24 +2,11 @@
 #include "frontends/common/parseInput.h"
 
 #include "compare.h"
+#include "options.h"
+#include "server.h"
 #include "toz3/common/create_z3.h"
 #include "toz3/common/visitor_interpret.h"
 
-std::vector<cstring> split_input_progs(cstring input_progs) {
-    std::vector<cstring> prog_list;
-    const char *pos = nullptr;
-    cstring prog;
-
-    while ((pos = input_progs.find((size_t)',')) != nullptr) {
-        auto idx = (size_t)(pos - input_progs);
-        prog = input_progs.substr(0, idx);
-        prog_list.push_back(prog);
-        input_progs = input_progs.substr(idx + 1);
-    }
-    prog_list.push_back(input_progs);
-    return prog_list;
-}
-
 int main(int argc, char *const argv[]) {
     AutoCompileContext autoP4toZ3Context(new TOZ3::P4toZ3Context);
     auto &options = TOZ3::P4toZ3Context::get().options();
@@ -27,7 +14,8 @@ int main(int argc, char *const argv[]) {
     options.langVersion = CompilerOptions::FrontendVersion::P4_16;
     options.compilerVersion = "p4toz3 test";
 
-    if (options.process(argc, argv) != nullptr) {
+    // The server reads its programs from the requests.
+    if (options.process(argc, argv) != nullptr && !options.server) {
         options.setInputFile();
     }
     if (::errorCount() > 0) {
@@ -36,6 +24,21 @@ int main(int argc, char *const argv[]) {
     // Initialize our logger
     TOZ3::Logger::init();
 
+    TOZ3::CompareConfig config;
+    config.allow_undefined = options.undefined_is_ok;
+    config.solver_threads = options.solver_threads;
+    config.solver_timeout = options.solver_timeout;
+    config.portfolio = options.solver_portfolio;
+    config.timeout_rounds = options.solver_rounds;
+    config.cache_dir = options.cache_dir;
+    config.cache_size = options.cache_size_mb * 1024 * 1024;
+    config.interpret_jobs = options.interpret_jobs;
+    config.stream = options.stream;
+    if (options.server) {
+        return TOZ3::run_server(options.server_socket, options.server_jobs,
+                                config);
+    }
+
     // check input file
     if (options.file == nullptr) {
         options.usage();
@@ -47,5 +50,5 @@ int main(int argc, char *const argv[]) {
         options.usage();
         return EXIT_FAILURE;
     }
-    return TOZ3::process_programs(prog_list, &options, options.undefined_is_ok);
+    return TOZ3::process_programs(prog_list, &options, config);
 }
@@ -1,5 +1,7 @@
 #include "options.h"
 
+#include <cstdlib>
+
 namespace TOZ3 {
 
 CompareOptions::CompareOptions() {
@@ -10,5 +12,123 @@ CompareOptions::CompareOptions() {
             return true;
         },
         "Toggle to tolerate undefined behavior in comparison.");
+    registerOption(
+        "--solver-threads", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_threads = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid number of solver threads: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Check the output fields of each pass pair in parallel with the "
+        "given number of threads.");
+    registerOption(
+        "--solver-timeout", "ms",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_timeout = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid solver timeout: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Timeout of a single solver query in milliseconds. Queries that "
+        "time out are retried with an escalating timeout.");
+    registerOption(
+        "--solver-portfolio", "configs",
+        [this](const char *arg) {
+            return parse_solver_portfolio(arg, &solver_portfolio);
+        },
+        "Race these comma-separated solver configurations on every query "
+        "and use the first answer. Known configurations are default, "
+        "qfbv-tactic and qfbv.");
+    registerOption(
+        "--solver-rounds", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_rounds = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0' || solver_rounds == 0) {
+                ::error("Invalid number of solver rounds: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "How often a query is tried when it times out. The timeout doubles "
+        "with every round.");
+    registerOption(
+        "--cache-dir", "folder",
+        [this](const char *arg) {
+            cache_dir = arg;
+            return true;
+        },
+        "Cache the Z3 representation of each program in this folder and "
+        "reuse it for programs with identical content. Solver results are "
+        "cached as well.");
+    registerOption(
+        "--cache-size", "megabytes",
+        [this](const char *arg) {
+            char *end = nullptr;
+            cache_size_mb = std::strtoull(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid cache size: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Size limit of the cache folder. The least recently used entries are "
+        "evicted first. Defaults to 1024 megabytes.");
+    registerOption(
+        "--interpret-jobs", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            interpret_jobs = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid number of interpreter jobs: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Interpret the programs in this many worker processes.");
+    registerOption(
+        "--stream", nullptr,
+        [this](const char *) {
+            stream = true;
+            return true;
+        },
+        "Compare each program right after interpreting it and keep only two "
+        "programs in memory.");
+    registerOption(
+        "--server", nullptr,
+        [this](const char *) {
+            server = true;
+            return true;
+        },
+        "Keep running and answer requests from stdin. Each request is a line "
+        "with a comma-separated list of programs, each reply a line of JSON.");
+    registerOption(
+        "--server-socket", "file",
+        [this](const char *arg) {
+            server = true;
+            server_socket = arg;
+            return true;
+        },
+        "Run as a server and read requests from this Unix socket.");
+    registerOption(
+        "--server-jobs", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            server_jobs = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0' || server_jobs == 0) {
+                ::error("Invalid number of server jobs: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Serve this many socket connections at once. Every connection gets "
+        "a warm context of its own. Defaults to 1.");
 }
 }  // namespace TOZ3
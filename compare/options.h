@@ -1,11 +1,15 @@
 #ifndef TOZ3_COMPARE_OPTIONS_H_
 #define TOZ3_COMPARE_OPTIONS_H_
 
+#include <vector>
+
 #include "ir/ir.h"
 
 #include "frontends/common/options.h"
 #include "lib/options.h"
 
+#include "compare.h"
+
 namespace TOZ3 {
 
 class CompareOptions : public CompilerOptions {
@@ -13,6 +17,28 @@ class CompareOptions : public CompilerOptions {
     CompareOptions();
     // Toggle this to allow differences in undefined behavior.
     bool undefined_is_ok = false;
+    // Number of threads used to check the output fields of a pass pair.
+    size_t solver_threads = 0;
+    // Timeout of a single solver query in milliseconds.
+    unsigned solver_timeout = 0;
+    // Solver configurations that race against each other.
+    std::vector<SolverConfig> solver_portfolio;
+    // How often a query is tried when it times out.
+    size_t solver_rounds = 3;
+    // Where the Z3 representations of interpreted programs are cached.
+    cstring cache_dir = nullptr;
+    // Size limit of the cache folder in megabytes.
+    uint64_t cache_size_mb = 1024;
+    // Number of worker processes which interpret the programs.
+    size_t interpret_jobs = 0;
+    // Compare each program right after interpreting it.
+    bool stream = false;
+    // Answer comparison requests until the input ends.
+    bool server = false;
+    // Read requests from this Unix socket instead of stdin.
+    cstring server_socket = nullptr;
+    // Number of socket connections served at once.
+    size_t server_jobs = 1;
 };
 
 using P4toZ3Context = P4CContextWithOptions<CompareOptions>;
@@ -0,0 +1,230 @@
+#include "server.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "options.h"
+#include "toz3/common/state.h"
+#include "toz3/common/util.h"
+
+namespace TOZ3 {
+
+struct WarmContext {
+    std::unique_ptr<z3::context> ctx;
+    // Interprets the programs of all requests in ctx.
+    std::unique_ptr<P4State> state;
+    // Programs interpreted in ctx, must be cleared before ctx is replaced.
+    ReprMap reprs;
+    size_t num_requests = 0;
+};
+
+static std::string handle_request(const std::string &request,
+                                  size_t request_id,
+                                  const CompareConfig &config,
+                                  WarmContext *warm) {
+    if (warm->ctx == nullptr || warm->num_requests >= SERVER_CONTEXT_REQUESTS) {
+        warm->reprs.clear();
+        warm->state.reset();
+        warm->ctx = std::make_unique<z3::context>();
+        warm->state = std::make_unique<P4State>(warm->ctx.get());
+        warm->num_requests = 0;
+    }
+    warm->num_requests++;
+
+    auto begin = std::chrono::steady_clock::now();
+    auto prog_list = split_input_progs(request);
+    CompareResult result;
+    result.exit_code = EXIT_FAILURE;
+    if (prog_list.size() < 2) {
+        result.error = "At least two input programs expected.";
+    } else {
+        // A fresh compile context drops the errors of earlier requests.
+        // P4CSections of this thread activate it while P4C is in use.
+        std::unique_ptr<P4toZ3Context> request_context;
+        {
+            P4CSection section;
+            request_context =
+                std::make_unique<P4toZ3Context>(P4toZ3Context::get());
+        }
+        P4CSection::set_thread_context(request_context.get());
+        auto &request_options = request_context->options();
+        try {
+            result = compare_program_list(prog_list, &request_options, config,
+                                          warm->state.get(), &warm->reprs);
+        } catch (z3::exception &ex) {
+            result.error = std::string("Z3 exception: ") + ex.msg();
+        } catch (const Util::P4CExceptionBase &bug) {
+            result.error = bug.what();
+        }
+        P4CSection::set_thread_context(nullptr);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    if (result.exit_code != EXIT_SUCCESS) {
+        std::cerr << result.error << std::endl;
+    }
+
+    std::stringstream reply;
+    reply << "{\"request\": " << request_id << ", \"programs\": [";
+    for (size_t idx = 0; idx < prog_list.size(); ++idx) {
+        reply << (idx == 0 ? "\"" : ", \"")
+              << escape_json(prog_list[idx].c_str()) << "\"";
+    }
+    reply << "], \"result\": \"" << get_exit_class(result.exit_code)
+          << "\", \"exit_code\": " << result.exit_code;
+    if (!result.error.empty()) {
+        reply << ", \"error\": \"" << escape_json(result.error) << "\"";
+    }
+    if (!result.counterexample.empty()) {
+        reply << ", \"counterexample\": \""
+              << escape_json(result.counterexample) << "\"";
+    }
+    reply << ", \"seconds\": " << std::chrono::duration<double>(elapsed).count()
+          << "}";
+    return reply.str();
+}
+
+// Returns false if the client asked the server to shut down.
+static bool serve_stream(FILE *input, FILE *output,
+                         const CompareConfig &config,
+                         std::atomic<size_t> *request_id, WarmContext *warm) {
+    char *line = nullptr;
+    size_t line_size = 0;
+    ssize_t line_len = 0;
+    bool keep_running = true;
+    while ((line_len = getline(&line, &line_size, input)) > 0) {
+        std::string request(line, line_len);
+        while (!request.empty() &&
+               (request.back() == '\n' || request.back() == '\r')) {
+            request.pop_back();
+        }
+        if (request.empty()) {
+            continue;
+        }
+        if (request == SERVER_SHUTDOWN) {
+            keep_running = false;
+            break;
+        }
+        auto reply = handle_request(request, (*request_id)++, config, warm);
+        fputs(reply.c_str(), output);
+        fputc('\n', output);
+        fflush(output);
+    }
+    free(line);
+    return keep_running;
+}
+
+static int open_server_socket(cstring socket_path) {
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        ::error("Socket path %s is too long.", socket_path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        ::error("Unable to create a socket: %s", strerror(errno));
+        return -1;
+    }
+    // Remove the socket of a previous server.
+    unlink(socket_path.c_str());
+    if (bind(server_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+            0 ||
+        listen(server_fd, SOMAXCONN) != 0) {
+        ::error("Unable to listen on %s: %s", socket_path, strerror(errno));
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+// Serves one connection after another. Returns false once a client asked
+// the server to shut down.
+static bool serve_connections(int server_fd, const CompareConfig &config,
+                              std::atomic<size_t> *request_id,
+                              WarmContext *warm) {
+    while (true) {
+        int conn_fd = accept(server_fd, nullptr, nullptr);
+        if (conn_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Another thread shut the socket down.
+            if (errno != EINVAL) {
+                ::error("Unable to accept a connection: %s", strerror(errno));
+            }
+            return true;
+        }
+        auto *input = fdopen(conn_fd, "r");
+        if (input == nullptr) {
+            close(conn_fd);
+            continue;
+        }
+        bool keep_running = true;
+        auto *output = fdopen(dup(conn_fd), "w");
+        if (output != nullptr) {
+            keep_running =
+                serve_stream(input, output, config, request_id, warm);
+            fclose(output);
+        }
+        fclose(input);
+        if (!keep_running) {
+            return false;
+        }
+    }
+}
+
+int run_server(cstring socket_path, size_t jobs,
+               const CompareConfig &server_config) {
+    // Hashing the source and its includes is cheaper than preprocessing,
+    // the include hashes are kept across requests.
+    auto config = server_config;
+    config.key_by_source = true;
+    std::atomic<size_t> request_id{0};
+    if (socket_path == nullptr) {
+        WarmContext warm;
+        serve_stream(stdin, stdout, config, &request_id, &warm);
+        return EXIT_SUCCESS;
+    }
+    int server_fd = open_server_socket(socket_path);
+    if (server_fd < 0) {
+        return EXIT_FAILURE;
+    }
+    // A client that disconnects early must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+    Logger::log_msg(0, "Listening on %s with %s jobs", socket_path, jobs);
+    // Every job serves its connections with a warm context of its own.
+    std::vector<WarmContext> pool(std::max<size_t>(jobs, 1));
+    std::vector<std::thread> workers;
+    for (auto &warm : pool) {
+        workers.emplace_back([&config, &request_id, &warm, server_fd] {
+            if (!serve_connections(server_fd, config, &request_id, &warm)) {
+                // Wake up the jobs that wait for a connection.
+                shutdown(server_fd, SHUT_RDWR);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    close(server_fd);
+    unlink(socket_path.c_str());
+    return ::errorCount() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}  // namespace TOZ3
@@ -0,0 +1,24 @@
+#ifndef TOZ3_COMPARE_SERVER_H_
+#define TOZ3_COMPARE_SERVER_H_
+
+#include "compare.h"
+
+namespace TOZ3 {
+// Requests share the interpreted programs of a warm Z3 context. Programs are
+// keyed by their source and includes, so unchanged programs skip the
+// preprocessor too. A context is replaced after this many requests to bound
+// its memory.
+constexpr size_t SERVER_CONTEXT_REQUESTS = 100;
+// Request which stops the server.
+constexpr auto SERVER_SHUTDOWN = "shutdown";
+
+// Answers comparison requests until the input ends or a shutdown request
+// arrives. Requests are read from stdin, or from a Unix socket if
+// socket_path is set. The socket serves up to jobs connections at once.
+// Every request is a line with a comma-separated list of programs, every
+// reply a line of JSON with the verdict and the counterexample, if any.
+int run_server(cstring socket_path, size_t jobs, const CompareConfig &config);
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_COMPARE_SERVER_H_
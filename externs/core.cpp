@@ -1,3 +1,4 @@
+#include "toz3/common/state.h"
 #include "toz3/common/type_complex.h"
 
 namespace TOZ3 {
@@ -28,7 +29,7 @@ class PacketIn : public ExternInstance {
     }
     // TODO: This is a little pointless....
     PacketIn *copy() const override {
-        return new PacketIn(state, extern_type);
+        return state->allocate<PacketIn>(state, extern_type);
     }
     P4Z3Instance *cast_allocate(const IR::Type *dest_type) const override;
 };
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Golden runs of p4compare on the programs in test/programs.
+
+Every pair is compared with each execution path of the tool and must give
+the same verdict: the plain run, the streaming comparison, the interpreter
+workers, the parallel solver, the solver portfolio and a partly and a fully
+warm cache.
+"""
+import argparse
+import logging
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+EXIT_SUCCESS = 0
+EXIT_VIOLATION = 20
+
+PASSED_MSG = "Passed all checks."
+VIOLATION_MSG = "Programs are not equal!"
+
+log = logging.getLogger(__name__)
+logging.basicConfig(format="%(levelname)s:%(message)s", level=logging.INFO)
+
+FILE_DIR = Path.resolve(Path(__file__)).parent
+PROG_DIR = FILE_DIR.joinpath("programs")
+
+# The programs to compare and the expected exit code and message.
+GOLDEN_RUNS = [
+    (["forward.p4", "forward_equal.p4"], EXIT_SUCCESS, PASSED_MSG),
+    (["forward.p4", "forward_bug.p4"], EXIT_VIOLATION, VIOLATION_MSG),
+    (["forward.p4", "forward_equal.p4", "forward_bug.p4"], EXIT_VIOLATION,
+     VIOLATION_MSG),
+    # The programs record their undefined values in a different order. Every
+    # path must still give them the same undefined constants.
+    (["undefined.p4", "undefined_equal.p4"], EXIT_SUCCESS, PASSED_MSG),
+]
+
+# The execution paths of p4compare.
+MODES = {
+    "plain": [],
+    "stream": ["--stream"],
+    "interpret_jobs": ["--interpret-jobs", "2"],
+    "interpret_jobs_undefined": ["--interpret-jobs", "2", "--allow-undefined"],
+    "solver_threads": ["--solver-threads", "2"],
+    "portfolio": ["--solver-portfolio", "default,qfbv-tactic,qfbv"],
+}
+
+
+def run_compare(p4compare, progs, flags):
+    prog_list = ",".join(str(PROG_DIR.joinpath(prog)) for prog in progs)
+    cmd = [p4compare] + flags + [prog_list]
+    log.debug("Executing %s", " ".join(cmd))
+    result = subprocess.run(cmd,
+                            stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT,
+                            check=False)
+    return result.returncode, result.stdout.decode("utf-8")
+
+
+def check_run(name, p4compare, progs, flags, exit_code, msg):
+    ret, output = run_compare(p4compare, progs, flags)
+    if ret != exit_code or msg not in output:
+        log.error("%s: %s returned %s, expected %s with \"%s\". Output:\n%s",
+                  name, ",".join(progs), ret, exit_code, msg, output)
+        return False
+    return True
+
+
+def check_cache(p4compare, progs, exit_code, msg):
+    with tempfile.TemporaryDirectory() as cache_dir:
+        flags = ["--cache-dir", cache_dir]
+        # Cache only the first program, so the next run compares a cached
+        # program with freshly interpreted ones.
+        if not check_run("first cached", p4compare, progs[:1] * 2, flags,
+                         EXIT_SUCCESS, PASSED_MSG):
+            return False
+        if not check_run("mixed cache", p4compare, progs, flags, exit_code,
+                         msg):
+            return False
+        # Every program leaves its representation.
+        reprs = list(Path(cache_dir).glob("*.smt2"))
+        if len(reprs) != len(progs):
+            log.error("cache: %s left %s representations.", ",".join(progs),
+                      len(reprs))
+            return False
+        return check_run("warm cache", p4compare, progs, flags, exit_code,
+                         msg)
+
+
+def main(args):
+    failures = 0
+    for progs, exit_code, msg in GOLDEN_RUNS:
+        for name, flags in MODES.items():
+            if not check_run(name, args.p4compare, progs, flags, exit_code,
+                             msg):
+                failures += 1
+        if not check_cache(args.p4compare, progs, exit_code, msg):
+            failures += 1
+    if failures:
+        log.error("%s golden runs failed.", failures)
+        return 1
+    log.info("All golden runs passed.")
+    return 0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--p4compare",
+                        dest="p4compare",
+                        required=True,
+                        help="The p4compare binary to test.")
+    sys.exit(main(parser.parse_args()))
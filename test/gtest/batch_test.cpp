@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+
+#include "toz3/common/util.h"
+#include "toz3/validate/batch.h"
+
+namespace TOZ3::Test {
+
+namespace fs = boost::filesystem;
+
+class BatchMerge : public ::testing::Test {
+ protected:
+    fs::path work_dir;
+
+    void SetUp() override {
+        work_dir = fs::temp_directory_path() /
+                   fs::unique_path("toz3_batch_%%%%-%%%%-%%%%");
+        fs::create_directories(work_dir);
+    }
+    void TearDown() override { fs::remove_all(work_dir); }
+
+    fs::path write_file(const std::string &name, const std::string &content) {
+        auto path = work_dir / name;
+        fs::create_directories(path.parent_path());
+        std::ofstream file(path.c_str());
+        file << content;
+        return path;
+    }
+    // Writes a result line in the format of the shard result files.
+    static std::string result_line(const std::string &content,
+                                   const std::string &exit_class,
+                                   const fs::path &p4_file) {
+        return hash_to_string(hash_content(content)) + "\t" + exit_class +
+               "\t0\t3\t1.5\t" + p4_file.string() + "\n";
+    }
+    // Returns the report lines without the header.
+    std::vector<std::string> read_report(const fs::path &report_path) {
+        std::ifstream report(report_path.c_str());
+        std::vector<std::string> lines;
+        std::string line;
+        std::getline(report, line);
+        EXPECT_EQ(line,
+                  "file,hash,result,exit_code,passes,seconds,duplicate_of");
+        while (std::getline(report, line)) {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+    static std::string csv_row(const fs::path &p4_file,
+                               const std::string &content,
+                               const std::string &result,
+                               const std::string &rest,
+                               const fs::path &duplicate_of = fs::path()) {
+        return "\"" + p4_file.string() + "\"," +
+               hash_to_string(hash_content(content)) + "," + result + "," +
+               rest + ",\"" + duplicate_of.string() + "\"";
+    }
+};
+
+TEST_F(BatchMerge, ReportsMissingAndDuplicatePrograms) {
+    auto prog_a = write_file("a.p4", "program a");
+    auto prog_b = write_file("b.p4", "program b");
+    auto prog_c = write_file("c.p4", "program c");
+    // Same content as a.p4, only a.p4 is validated.
+    auto prog_d = write_file("d with space.p4", "program a");
+    auto shard_0 = write_file(
+        "shard_0.tsv", result_line("program a", "EXIT_SUCCESS", prog_a));
+    // The second shard ends with a line cut off by a dying node.
+    auto shard_1 = write_file(
+        "shard_1.tsv", result_line("program b", "VALIDATION_BUG", prog_b) +
+                           hash_to_string(hash_content("program c")) + "\tEX");
+
+    BatchConfig config;
+    auto report_path = work_dir / "report.csv";
+    config.report = report_path.c_str();
+    int result = merge_results({shard_0, shard_1},
+                               {prog_a, prog_b, prog_c, prog_d}, work_dir,
+                               config);
+    EXPECT_EQ(result, EXIT_FAILURE);
+
+    std::vector<std::string> expected = {
+        csv_row(prog_a, "program a", "EXIT_SUCCESS", "0,3,1.5"),
+        csv_row(prog_b, "program b", "VALIDATION_BUG", "0,3,1.5"),
+        csv_row(prog_c, "program c", "MISSING", "-1,0,0"),
+        csv_row(prog_d, "program a", "EXIT_SUCCESS", "0,3,0", prog_a),
+    };
+    EXPECT_EQ(read_report(report_path), expected);
+}
+
+TEST_F(BatchMerge, SkipsDuplicateResults) {
+    auto prog_a = write_file("a.p4", "program a");
+    auto line = result_line("program a", "EXIT_SUCCESS", prog_a);
+    // Overlapping shards report the same program twice.
+    auto shard_0 = write_file("shard_0.tsv", line);
+    auto shard_1 = write_file("shard_1.tsv", line);
+
+    BatchConfig config;
+    auto report_path = work_dir / "report.csv";
+    config.report = report_path.c_str();
+    int result = merge_results({shard_0, shard_1}, {prog_a}, work_dir, config);
+    EXPECT_EQ(result, EXIT_SUCCESS);
+
+    std::vector<std::string> expected = {
+        csv_row(prog_a, "program a", "EXIT_SUCCESS", "0,3,1.5"),
+    };
+    EXPECT_EQ(read_report(report_path), expected);
+}
+
+TEST_F(BatchMerge, KeysProgramsByLocalIncludes) {
+    // Equal programs which include different headers next to them.
+    auto prog_x = write_file("x/prog.p4", "#include \"h.p4\"\n");
+    write_file("x/h.p4", "header x");
+    auto prog_y = write_file("y/prog.p4", "#include \"h.p4\"\n");
+    write_file("y/h.p4", "header y");
+    auto prog_z = write_file("z/prog.p4", "#include \"h.p4\"\n");
+    write_file("z/h.p4", "header x");
+
+    BatchConfig config;
+    auto report_path = work_dir / "report.csv";
+    config.report = report_path.c_str();
+    int result =
+        merge_results({}, {prog_x, prog_y, prog_z}, work_dir, config);
+    EXPECT_EQ(result, EXIT_FAILURE);
+
+    auto lines = read_report(report_path);
+    ASSERT_EQ(lines.size(), 3U);
+    auto hash_of = [](const std::string &line, const fs::path &p4_file) {
+        auto prefix = "\"" + p4_file.string() + "\",";
+        EXPECT_EQ(line.rfind(prefix, 0), 0);
+        return line.substr(prefix.size(), line.find(',', prefix.size()) -
+                                              prefix.size());
+    };
+    EXPECT_NE(hash_of(lines[0], prog_x), hash_of(lines[1], prog_y));
+    EXPECT_NE(hash_of(lines[0], prog_x),
+              hash_to_string(hash_content("#include \"h.p4\"\n")));
+    // Only the program with the same header is a duplicate.
+    auto dup_suffix = ",\"" + prog_x.string() + "\"";
+    EXPECT_EQ(lines[2].substr(lines[2].size() - dup_suffix.size()),
+              dup_suffix);
+}
+
+}  // namespace TOZ3::Test
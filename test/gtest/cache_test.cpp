@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+
+#include "toz3/common/util.h"
+#include "toz3/compare/cache.h"
+
+namespace TOZ3::Test {
+
+namespace fs = boost::filesystem;
+
+class Cache : public ::testing::Test {
+ protected:
+    fs::path cache_dir;
+    z3::context ctx;
+
+    void SetUp() override {
+        cache_dir = fs::temp_directory_path() /
+                    fs::unique_path("toz3_cache_%%%%-%%%%-%%%%");
+        fs::create_directories(cache_dir);
+    }
+    void TearDown() override { fs::remove_all(cache_dir); }
+
+    // A representation with two undefined constants which only differ by
+    // their sort, as the interpreter creates them.
+    Z3Fields make_fields(std::vector<z3::expr> *undefined_vars) {
+        auto undef_bv = ctx.bv_const(UNDEF_LABEL, 8);
+        auto undef_bool = ctx.bool_const(UNDEF_LABEL);
+        undefined_vars->push_back(undef_bv);
+        undefined_vars->push_back(undef_bool);
+        auto input = ctx.bv_const("hdr.h.a", 8);
+        Z3Fields fields;
+        fields.emplace_back("hdr.h.a", input + undef_bv);
+        fields.emplace_back("hdr.h.$valid$",
+                            z3::ite(undef_bool, ctx.bool_val(true),
+                                    input == ctx.bv_val(1, 8)));
+        return fields;
+    }
+    fs::path write_entry(const std::string &name, std::time_t mtime) {
+        auto path = cache_dir / name;
+        std::ofstream entry(path.c_str());
+        entry << std::string(100, 'x');
+        entry.close();
+        fs::last_write_time(path, mtime);
+        return path;
+    }
+};
+
+TEST_F(Cache, ReprRoundTrip) {
+    std::vector<z3::expr> undefined_vars;
+    auto fields = make_fields(&undefined_vars);
+    auto repr_path = (cache_dir / "repr.smt2").string();
+    write_z3_repr(&ctx, repr_path, fields, undefined_vars);
+
+    Z3Fields loaded_fields;
+    std::vector<z3::expr> loaded_vars;
+    ASSERT_TRUE(read_z3_repr(&ctx, repr_path, &loaded_fields, &loaded_vars));
+    ASSERT_EQ(loaded_fields.size(), fields.size());
+    ASSERT_EQ(loaded_vars.size(), undefined_vars.size());
+    EXPECT_EQ(loaded_fields[0].first, "hdr.h.a");
+    EXPECT_EQ(loaded_fields[1].first, "hdr.h.$valid$");
+    // The loaded program shares the undefined constants with the original.
+    for (size_t idx = 0; idx < loaded_vars.size(); ++idx) {
+        EXPECT_TRUE(z3::eq(loaded_vars[idx], undefined_vars[idx]));
+    }
+    for (size_t idx = 0; idx < fields.size(); ++idx) {
+        z3::solver solver(ctx);
+        solver.add(loaded_fields[idx].second != fields[idx].second);
+        EXPECT_EQ(solver.check(), z3::unsat) << loaded_fields[idx].first;
+    }
+}
+
+TEST_F(Cache, ReprOrderDoesNotMatter) {
+    // Two programs that record their undefined constants in a different
+    // order must still agree on equal fields.
+    std::vector<z3::expr> undefined_vars;
+    auto fields = make_fields(&undefined_vars);
+    std::vector<z3::expr> reversed_vars(undefined_vars.rbegin(),
+                                        undefined_vars.rend());
+    auto first_path = (cache_dir / "first.smt2").string();
+    auto second_path = (cache_dir / "second.smt2").string();
+    write_z3_repr(&ctx, first_path, fields, undefined_vars);
+    write_z3_repr(&ctx, second_path, fields, reversed_vars);
+
+    Z3Fields first_fields;
+    Z3Fields second_fields;
+    std::vector<z3::expr> first_vars;
+    std::vector<z3::expr> second_vars;
+    ASSERT_TRUE(read_z3_repr(&ctx, first_path, &first_fields, &first_vars));
+    ASSERT_TRUE(
+        read_z3_repr(&ctx, second_path, &second_fields, &second_vars));
+    for (size_t idx = 0; idx < fields.size(); ++idx) {
+        z3::solver solver(ctx);
+        solver.add(first_fields[idx].second != second_fields[idx].second);
+        EXPECT_EQ(solver.check(), z3::unsat) << first_fields[idx].first;
+    }
+}
+
+TEST_F(Cache, RejectsBrokenRepr) {
+    auto repr_path = (cache_dir / "broken.smt2").string();
+    {
+        std::ofstream repr_file(repr_path);
+        repr_file << "; 2 0\n; hdr.h.a\n";
+    }
+    Z3Fields fields;
+    std::vector<z3::expr> undefined_vars;
+    EXPECT_FALSE(read_z3_repr(&ctx, repr_path, &fields, &undefined_vars));
+    EXPECT_TRUE(fields.empty());
+    EXPECT_FALSE(read_z3_repr(&ctx, (cache_dir / "none.smt2").string(),
+                              &fields, &undefined_vars));
+}
+
+TEST_F(Cache, StoreAndLoadByKey) {
+    std::vector<z3::expr> undefined_vars;
+    auto fields = make_fields(&undefined_vars);
+    store_z3_repr(&ctx, cache_dir.c_str(), 42, fields, undefined_vars);
+    EXPECT_TRUE(fs::is_regular_file(cache_dir / "000000000000002a.smt2"));
+
+    Z3Fields loaded_fields;
+    std::vector<z3::expr> loaded_vars;
+    EXPECT_FALSE(load_z3_repr(&ctx, cache_dir.c_str(), 43, &loaded_fields,
+                              &loaded_vars));
+    EXPECT_TRUE(load_z3_repr(&ctx, cache_dir.c_str(), 42, &loaded_fields,
+                             &loaded_vars));
+    EXPECT_EQ(loaded_fields.size(), fields.size());
+}
+
+TEST_F(Cache, StoreAndLoadCheckResult) {
+    auto var = ctx.bv_const("x", 8);
+    z3::solver solver(ctx);
+    solver.add(var == ctx.bv_val(7, 8));
+    ASSERT_EQ(solver.check(), z3::sat);
+    store_check_result(&ctx, cache_dir.c_str(), 1, z3::sat, solver.get_model());
+
+    z3::check_result result = z3::unknown;
+    z3::model model(ctx);
+    ASSERT_TRUE(
+        load_check_result(&ctx, cache_dir.c_str(), 1, &result, &model));
+    EXPECT_EQ(result, z3::sat);
+    EXPECT_EQ(model.eval(var).get_numeral_uint(), 7U);
+    EXPECT_FALSE(
+        load_check_result(&ctx, cache_dir.c_str(), 2, &result, &model));
+}
+
+TEST_F(Cache, EvictsLeastRecentlyUsed) {
+    auto now = std::time(nullptr);
+    auto oldest = write_entry("oldest.smt2", now - 300);
+    auto older = write_entry("older.smt2", now - 200);
+    auto newest = write_entry("newest.smt2", now - 100);
+
+    // Everything fits, nothing is removed.
+    evict_cache(cache_dir.c_str(), 300);
+    EXPECT_TRUE(fs::exists(oldest));
+
+    evict_cache(cache_dir.c_str(), 150);
+    EXPECT_FALSE(fs::exists(oldest));
+    EXPECT_FALSE(fs::exists(older));
+    EXPECT_TRUE(fs::exists(newest));
+}
+
+TEST_F(Cache, EvictorRunsOnScopeExit) {
+    auto entry = write_entry("entry.smt2", std::time(nullptr));
+    { CacheEvictor evictor(nullptr, 0); }
+    EXPECT_TRUE(fs::exists(entry));
+    { CacheEvictor evictor(cache_dir.c_str(), 0); }
+    EXPECT_FALSE(fs::exists(entry));
+}
+
+TEST_F(Cache, QueryKeyIgnoresFreshNames) {
+    // Fresh constants are numbered per context, their keys must still match.
+    z3::context other_ctx;
+    other_ctx.fresh_constant("unrelated", other_ctx.bool_sort());
+    auto make_query = [](z3::context &query_ctx) {
+        auto taint = query_ctx.fresh_constant("taint", query_ctx.bv_sort(8));
+        auto input = query_ctx.bv_const("hdr.h.a", 8);
+        return (input & taint) != query_ctx.bv_val(0, 8);
+    };
+    auto query = make_query(ctx);
+    EXPECT_EQ(get_query_cache_key(query), get_query_cache_key(query));
+    EXPECT_EQ(get_query_cache_key(query),
+              get_query_cache_key(make_query(other_ctx)));
+    auto input = ctx.bv_const("hdr.h.a", 8);
+    EXPECT_NE(get_query_cache_key(query),
+              get_query_cache_key(input != ctx.bv_val(0, 8)));
+}
+
+}  // namespace TOZ3::Test
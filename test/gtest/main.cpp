@@ -0,0 +1,12 @@
+#include <gtest/gtest.h>
+
+#include "lib/compile_context.h"
+
+#include "toz3/compare/options.h"
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    // cstrings and errors need an active compile context.
+    AutoCompileContext autoP4toZ3Context(new TOZ3::P4toZ3Context);
+    return RUN_ALL_TESTS();
+}
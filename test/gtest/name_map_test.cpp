@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "toz3/common/name_map.h"
+
+namespace TOZ3::Test {
+
+TEST(NameMap, KeepsInsertionOrder) {
+    NameMap<int> map;
+    map["c"] = 1;
+    map["a"] = 2;
+    map["b"] = 3;
+    std::string order;
+    for (const auto &entry : map) {
+        order += entry.first.c_str();
+    }
+    EXPECT_EQ(order, "cab");
+}
+
+TEST(NameMap, InsertDoesNotOverwrite) {
+    NameMap<int> map;
+    EXPECT_TRUE(map.insert({"a", 1}).second);
+    auto result = map.insert({"a", 2});
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ(result.first->second, 1);
+    EXPECT_EQ(map.size(), 1U);
+}
+
+TEST(NameMap, FindsNamesPastTheLinearLimit) {
+    // Enough names to switch from the linear search to the index.
+    constexpr int num_names = 100;
+    NameMap<int> map;
+    for (int idx = 0; idx < num_names; ++idx) {
+        map.insert({cstring("name_" + std::to_string(idx)), idx});
+    }
+    ASSERT_EQ(map.size(), static_cast<size_t>(num_names));
+    for (int idx = 0; idx < num_names; ++idx) {
+        cstring name = "name_" + std::to_string(idx);
+        ASSERT_EQ(map.count(name), 1U);
+        EXPECT_EQ(map.at(name), idx);
+    }
+    EXPECT_EQ(map.count("name_100"), 0U);
+    EXPECT_EQ(map.find("missing"), map.end());
+}
+
+TEST(NameMap, ClearRemovesTheIndex) {
+    NameMap<int> map;
+    for (int idx = 0; idx < 20; ++idx) {
+        map[cstring("name_" + std::to_string(idx))] = idx;
+    }
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.count("name_3"), 0U);
+    map["name_3"] = 3;
+    EXPECT_EQ(map.at("name_3"), 3);
+}
+
+}  // namespace TOZ3::Test
@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+#include "toz3/common/util.h"
+
+namespace TOZ3::Test {
+
+TEST(HashContent, IsFnv1a) {
+    // Reference values of 64 bit FNV-1a.
+    EXPECT_EQ(hash_content(""), 14695981039346656037ULL);
+    EXPECT_EQ(hash_content("a"), 0xaf63dc4c8601ec8cULL);
+    EXPECT_EQ(hash_content("foobar"), 0x85944171f73967e8ULL);
+}
+
+TEST(HashContent, ChainsThroughTheSeed) {
+    EXPECT_EQ(hash_content("bar", hash_content("foo")), hash_content("foobar"));
+    EXPECT_NE(hash_content("foo", 1), hash_content("foo", 2));
+}
+
+TEST(HashContent, CoversEveryByte) {
+    std::string content("a\0b", 3);
+    EXPECT_NE(hash_content(content), hash_content("a"));
+    EXPECT_NE(hash_content("ab"), hash_content("ba"));
+}
+
+TEST(HashToString, PadsToSixteenDigits) {
+    EXPECT_EQ(hash_to_string(0), "0000000000000000");
+    EXPECT_EQ(hash_to_string(0xabcULL), "0000000000000abc");
+    EXPECT_EQ(hash_to_string(UINT64_MAX), "ffffffffffffffff");
+}
+
+}  // namespace TOZ3::Test
@@ -0,0 +1,484 @@
+#include "batch.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../common/util.h"
+
+namespace TOZ3 {
+
+namespace fs = boost::filesystem;
+
+static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(10);
+static constexpr auto WORKER_LOG = "validate.log";
+
+struct BatchEntry {
+    fs::path p4_file;
+    fs::path dump_dir;
+    uint64_t hash = 0;
+    cstring exit_class = "EXIT_FAILURE";
+    int exit_code = EXIT_FAILURE;
+    size_t num_passes = 0;
+    double seconds = 0;
+    // Set if the program has the same content as this validated program.
+    fs::path duplicate_of;
+};
+
+struct BatchWorker {
+    size_t entry_idx;
+    pid_t pid;
+    int result_fd;
+    std::chrono::steady_clock::time_point start;
+    bool timed_out;
+};
+
+std::vector<fs::path> collect_batch_files(const fs::path &input) {
+    std::vector<fs::path> p4_files;
+    if (fs::is_directory(input)) {
+        for (fs::recursive_directory_iterator it(input), end; it != end; ++it) {
+            if (fs::is_regular_file(it->path()) &&
+                it->path().extension() == ".p4") {
+                p4_files.push_back(it->path());
+            }
+        }
+        // Keep the order stable across runs.
+        std::sort(p4_files.begin(), p4_files.end());
+        return p4_files;
+    }
+    std::ifstream list_file(input.c_str());
+    if (!list_file.is_open()) {
+        ::error("Unable to open batch input %s.", input.c_str());
+        return p4_files;
+    }
+    std::string line;
+    while (std::getline(list_file, line)) {
+        if (!line.empty() && line[0] != '#') {
+            p4_files.emplace_back(line);
+        }
+    }
+    return p4_files;
+}
+
+// Returns the name of a quoted include next to the including file. Other
+// includes come from the same include folders for the whole corpus.
+static bool parse_local_include(const std::string &line,
+                                const fs::path &parent, std::string *name) {
+    auto pos = line.find_first_not_of(" \t");
+    if (pos == std::string::npos || line[pos] != '#') {
+        return false;
+    }
+    pos = line.find_first_not_of(" \t", pos + 1);
+    if (pos == std::string::npos || line.compare(pos, 7, "include") != 0) {
+        return false;
+    }
+    pos = line.find_first_not_of(" \t", pos + 7);
+    if (pos == std::string::npos || line[pos] != '"') {
+        return false;
+    }
+    auto end = line.find('"', pos + 1);
+    if (end == std::string::npos) {
+        return false;
+    }
+    *name = line.substr(pos + 1, end - pos - 1);
+    boost::system::error_code ec;
+    return fs::is_regular_file(parent / *name, ec);
+}
+
+// Hashes the content of a program and of its local includes. The include
+// names are relative, so every node computes the same hash.
+static uint64_t hash_file(const fs::path &p4_file,
+                          std::set<std::string> *visited) {
+    std::ifstream input(p4_file.c_str());
+    std::stringstream content;
+    content << input.rdbuf();
+    auto hash = hash_content(content.str());
+    std::string line;
+    std::string name;
+    while (std::getline(content, line)) {
+        if (!parse_local_include(line, p4_file.parent_path(), &name)) {
+            continue;
+        }
+        auto include = p4_file.parent_path() / name;
+        if (!visited->insert(include.string()).second) {
+            continue;
+        }
+        auto include_hash = hash_file(include, visited);
+        hash = hash_content(name + ":" + hash_to_string(include_hash), hash);
+    }
+    return hash;
+}
+
+static uint64_t hash_file(const fs::path &p4_file) {
+    std::set<std::string> visited = {p4_file.string()};
+    return hash_file(p4_file, &visited);
+}
+
+static void append_result(const fs::path &results_path,
+                          const BatchEntry &entry) {
+    // One line per program, flushed right away so a dying node keeps all
+    // results it has finished. The file name comes last, it may have spaces.
+    std::ofstream results(results_path.c_str(), std::ios::app);
+    results << hash_to_string(entry.hash) << "\t" << entry.exit_class << "\t"
+            << entry.exit_code << "\t" << entry.num_passes << "\t"
+            << entry.seconds << "\t" << entry.p4_file.string() << std::endl;
+}
+
+static std::vector<BatchEntry> load_results(const fs::path &results_path) {
+    std::vector<BatchEntry> entries;
+    std::ifstream results(results_path.c_str());
+    std::string line;
+    while (std::getline(results, line)) {
+        std::stringstream fields(line);
+        std::string hash_str;
+        std::string exit_class;
+        BatchEntry entry;
+        if (!(fields >> hash_str >> exit_class >> entry.exit_code >>
+              entry.num_passes >> entry.seconds)) {
+            // A node may have died in the middle of a line.
+            continue;
+        }
+        std::string file_name;
+        fields.ignore(1);
+        std::getline(fields, file_name);
+        entry.hash = std::strtoull(hash_str.c_str(), nullptr, 16);
+        entry.exit_class = exit_class;
+        entry.p4_file = file_name;
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+static bool spawn_worker(size_t entry_idx, const BatchEntry &entry,
+                         const BatchValidator &validate, BatchWorker *worker) {
+    std::array<int, 2> result_pipe{};
+    if (pipe(result_pipe.data()) != 0) {
+        return false;
+    }
+    fs::create_directories(entry.dump_dir);
+    // Do not duplicate buffered output in the child.
+    std::cout.flush();
+    std::cerr.flush();
+    auto pid = fork();
+    if (pid < 0) {
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // The worker inherits the warm state of the parent. It gets its own
+        // process group so a timeout also stops the compiler it spawned.
+        setpgid(0, 0);
+        close(result_pipe[0]);
+        auto log_path = entry.dump_dir / WORKER_LOG;
+        int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log_fd >= 0) {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+            close(log_fd);
+        }
+        size_t num_passes = 0;
+        int result = validate(entry.p4_file, entry.dump_dir, &num_passes);
+        auto passes_str = std::to_string(num_passes);
+        auto written = write(result_pipe[1], passes_str.c_str(),
+                             passes_str.size());
+        (void)written;
+        close(result_pipe[1]);
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(result);
+    }
+    setpgid(pid, pid);
+    close(result_pipe[1]);
+    *worker = {entry_idx, pid, result_pipe[0],
+               std::chrono::steady_clock::now(), false};
+    return true;
+}
+
+static void finish_worker(const BatchWorker &worker, int status,
+                          const fs::path &results_path, BatchEntry *entry) {
+    std::array<char, 32> buffer{};
+    auto read_bytes = read(worker.result_fd, buffer.data(), buffer.size() - 1);
+    close(worker.result_fd);
+    if (read_bytes > 0) {
+        entry->num_passes = std::strtoull(buffer.data(), nullptr, 10);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - worker.start;
+    entry->seconds = std::chrono::duration<double>(elapsed).count();
+    if (worker.timed_out) {
+        entry->exit_class = "TIMEOUT";
+        entry->exit_code = -1;
+    } else if (WIFSIGNALED(status)) {
+        entry->exit_class = "CRASH";
+        entry->exit_code = -WTERMSIG(status);
+    } else if (WIFEXITED(status)) {
+        entry->exit_code = WEXITSTATUS(status);
+        entry->exit_class = get_exit_class(entry->exit_code);
+    }
+    Logger::log_msg(0, "%s: %s after %s seconds", entry->p4_file,
+                    entry->exit_class, entry->seconds);
+    append_result(results_path, *entry);
+}
+
+// Programs with the same content as another program are only validated
+// once. They are reported with the result of their twin.
+static void add_duplicates(const std::vector<BatchEntry> &duplicates,
+                           std::vector<BatchEntry> *entries) {
+    std::map<uint64_t, size_t> entry_ids;
+    for (size_t idx = 0; idx < entries->size(); ++idx) {
+        entry_ids.emplace(entries->at(idx).hash, idx);
+    }
+    for (const auto &duplicate : duplicates) {
+        auto it = entry_ids.find(duplicate.hash);
+        if (it == entry_ids.end()) {
+            // The twin itself has no result.
+            auto entry = duplicate;
+            entry.exit_class = "MISSING";
+            entry.exit_code = -1;
+            entries->push_back(entry);
+            continue;
+        }
+        auto entry = entries->at(it->second);
+        entry.p4_file = duplicate.p4_file;
+        entry.duplicate_of = duplicate.duplicate_of;
+        entry.seconds = 0;
+        entries->push_back(entry);
+    }
+}
+
+static std::string escape_csv(const std::string &str) {
+    std::string escaped = "\"";
+    for (auto chr : str) {
+        if (chr == '"') {
+            escaped += '"';
+        }
+        escaped += chr;
+    }
+    return escaped + "\"";
+}
+
+static void write_report(const std::vector<BatchEntry> &entries,
+                         const std::map<cstring, size_t> &summary,
+                         const fs::path &report_path) {
+    std::ofstream report(report_path.c_str());
+    if (!report.is_open()) {
+        ::error("Unable to write batch report %s.", report_path.c_str());
+        return;
+    }
+    if (report_path.extension() == ".csv") {
+        report << "file,hash,result,exit_code,passes,seconds,duplicate_of\n";
+        for (const auto &entry : entries) {
+            report << escape_csv(entry.p4_file.string()) << ","
+                   << hash_to_string(entry.hash) << "," << entry.exit_class
+                   << "," << entry.exit_code << "," << entry.num_passes << ","
+                   << entry.seconds << ","
+                   << escape_csv(entry.duplicate_of.string()) << "\n";
+        }
+        return;
+    }
+    report << "{\n  \"programs\": [";
+    for (size_t idx = 0; idx < entries.size(); ++idx) {
+        const auto &entry = entries[idx];
+        report << (idx == 0 ? "\n" : ",\n");
+        report << "    {\"file\": \"" << escape_json(entry.p4_file.string())
+               << "\", \"hash\": \"" << hash_to_string(entry.hash)
+               << "\", \"result\": \"" << entry.exit_class
+               << "\", \"exit_code\": " << entry.exit_code
+               << ", \"passes\": " << entry.num_passes
+               << ", \"seconds\": " << entry.seconds;
+        if (!entry.duplicate_of.empty()) {
+            report << ", \"duplicate_of\": \""
+                   << escape_json(entry.duplicate_of.string()) << "\"";
+        }
+        report << "}";
+    }
+    report << "\n  ],\n  \"summary\": {";
+    bool first = true;
+    for (const auto &result : summary) {
+        report << (first ? "\n" : ",\n");
+        report << "    \"" << result.first << "\": " << result.second;
+        first = false;
+    }
+    report << "\n  }\n}\n";
+}
+
+static void report_entries(const std::vector<BatchEntry> &entries,
+                           std::map<cstring, size_t> *summary,
+                           const fs::path &report_path) {
+    for (const auto &entry : entries) {
+        (*summary)[entry.exit_class]++;
+    }
+    for (const auto &result : *summary) {
+        Logger::log_msg(0, "%s: %s programs", result.first, result.second);
+    }
+    write_report(entries, *summary, report_path);
+}
+
+int run_batch(const std::vector<fs::path> &p4_files, const fs::path &dump_dir,
+              const BatchConfig &config, const BatchValidator &validate) {
+    // Shards get their own files, so several shards can share a machine.
+    auto shard_name = "shard_" + std::to_string(config.shard_index) + "_of_" +
+                      std::to_string(config.shard_count);
+    auto results_path = config.results != nullptr
+                            ? fs::path(config.results.c_str())
+                            : dump_dir / (shard_name + ".tsv");
+    auto report_path = config.report != nullptr
+                           ? fs::path(config.report.c_str())
+                           : dump_dir / (shard_name + ".json");
+    // Resume a shard that was interrupted, programs with identical content
+    // and local includes are only validated once.
+    std::map<uint64_t, fs::path> done_files;
+    for (const auto &entry : load_results(results_path)) {
+        done_files.emplace(entry.hash, entry.p4_file);
+    }
+    size_t num_resumed = 0;
+    std::vector<BatchEntry> entries;
+    std::vector<BatchEntry> duplicates;
+    std::set<std::string> dump_names;
+    for (const auto &p4_file : p4_files) {
+        BatchEntry entry;
+        entry.p4_file = p4_file;
+        entry.hash = hash_file(p4_file);
+        // The hash decides the shard, so every node computes the same split.
+        if (entry.hash % config.shard_count != config.shard_index) {
+            continue;
+        }
+        auto done_file = done_files.emplace(entry.hash, p4_file);
+        if (!done_file.second) {
+            if (done_file.first->second == p4_file) {
+                num_resumed++;
+            } else {
+                entry.duplicate_of = done_file.first->second;
+                duplicates.push_back(entry);
+            }
+            continue;
+        }
+        // Programs in different folders may share a name.
+        auto dump_name = p4_file.stem().string();
+        if (!dump_names.insert(dump_name).second) {
+            dump_name += "_" + std::to_string(entries.size());
+            dump_names.insert(dump_name);
+        }
+        entry.dump_dir = dump_dir / shard_name / dump_name;
+        entries.push_back(entry);
+    }
+
+    auto num_entries = entries.size();
+    Logger::log_msg(0,
+                    "Shard %s of %s: %s programs to validate, %s skipped, "
+                    "%s duplicates",
+                    config.shard_index, config.shard_count, num_entries,
+                    num_resumed, duplicates.size());
+
+    auto jobs = std::max<size_t>(config.jobs, 1);
+    std::vector<BatchWorker> workers;
+    size_t next_entry = 0;
+    while (next_entry < entries.size() || !workers.empty()) {
+        while (next_entry < entries.size() && workers.size() < jobs) {
+            BatchWorker worker{};
+            if (spawn_worker(next_entry, entries[next_entry], validate,
+                             &worker)) {
+                workers.push_back(worker);
+            } else {
+                Logger::log_msg(0, "Failed to start a worker for %s",
+                                entries[next_entry].p4_file);
+            }
+            next_entry++;
+        }
+        int status = 0;
+        auto pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            auto worker = std::find_if(
+                workers.begin(), workers.end(),
+                [pid](const BatchWorker &w) { return w.pid == pid; });
+            if (worker != workers.end()) {
+                finish_worker(*worker, status, results_path,
+                              &entries[worker->entry_idx]);
+                workers.erase(worker);
+            }
+            continue;
+        }
+        if (config.timeout > 0) {
+            auto now = std::chrono::steady_clock::now();
+            auto budget = std::chrono::seconds(config.timeout);
+            for (auto &worker : workers) {
+                if (!worker.timed_out && now - worker.start > budget) {
+                    kill(-worker.pid, SIGKILL);
+                    worker.timed_out = true;
+                }
+            }
+        }
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+
+    // The report covers the whole shard, including resumed results.
+    std::map<cstring, size_t> summary;
+    auto results = load_results(results_path);
+    add_duplicates(duplicates, &results);
+    report_entries(results, &summary, report_path);
+    return ::errorCount() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int merge_results(const std::vector<fs::path> &results_files,
+                  const std::vector<fs::path> &corpus_files,
+                  const fs::path &dump_dir, const BatchConfig &config) {
+    std::vector<BatchEntry> entries;
+    std::map<uint64_t, fs::path> seen_files;
+    std::map<cstring, size_t> summary;
+    for (const auto &results_path : results_files) {
+        if (!fs::is_regular_file(results_path)) {
+            ::error("Result file %s does not exist.", results_path.c_str());
+            continue;
+        }
+        for (const auto &entry : load_results(results_path)) {
+            if (seen_files.emplace(entry.hash, entry.p4_file).second) {
+                entries.push_back(entry);
+                continue;
+            }
+            // Overlapping shards or a program listed twice.
+            Logger::log_msg(0, "Duplicate result for %s in %s",
+                            entry.p4_file, results_path);
+            summary["DUPLICATE"]++;
+        }
+    }
+    std::vector<BatchEntry> duplicates;
+    for (const auto &p4_file : corpus_files) {
+        BatchEntry entry;
+        entry.p4_file = p4_file;
+        entry.hash = hash_file(p4_file);
+        auto seen_file = seen_files.emplace(entry.hash, p4_file);
+        if (seen_file.second) {
+            Logger::log_msg(0, "Missing result for %s", entry.p4_file);
+            entry.exit_class = "MISSING";
+            entry.exit_code = -1;
+            entries.push_back(entry);
+        } else if (seen_file.first->second != p4_file) {
+            entry.duplicate_of = seen_file.first->second;
+            duplicates.push_back(entry);
+        }
+    }
+    add_duplicates(duplicates, &entries);
+    auto report_path = config.report != nullptr
+                           ? fs::path(config.report.c_str())
+                           : dump_dir / "batch_report.json";
+    report_entries(entries, &summary, report_path);
+    if (::errorCount() > 0 || summary.count("MISSING") > 0) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+}  // namespace TOZ3
@@ -0,0 +1,58 @@
+#ifndef TOZ3_VALIDATE_BATCH_H_
+#define TOZ3_VALIDATE_BATCH_H_
+
+#include <functional>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+
+#include "ir/ir.h"
+
+namespace TOZ3 {
+
+struct BatchConfig {
+    // Number of programs that are validated concurrently.
+    size_t jobs = 1;
+    // Wall-clock budget of a single program in seconds, 0 means no limit.
+    unsigned timeout = 0;
+    // The summary is written as CSV if the file ends in .csv, else as JSON.
+    cstring report;
+    // The corpus is split into shards by the content hash of the programs
+    // and their local includes.
+    size_t shard_index = 0;
+    size_t shard_count = 1;
+    // Append-only file with one line per finished program of this shard.
+    cstring results;
+};
+
+// Validates a single program and reports the number of compared passes.
+using BatchValidator =
+    std::function<int(const boost::filesystem::path &p4_file,
+                      const boost::filesystem::path &dump_dir,
+                      size_t *num_passes)>;
+
+// Collects the P4 files of a corpus. The input is either a directory, which
+// is searched recursively, or a list file with one program path per line.
+std::vector<boost::filesystem::path> collect_batch_files(
+    const boost::filesystem::path &input);
+
+// Validates every program of the shard in a forked worker process and writes
+// the summary. Programs which already have a result are skipped. Programs
+// with the same content as another one are validated once and reported
+// with the result of that program in their duplicate_of column.
+int run_batch(const std::vector<boost::filesystem::path> &p4_files,
+              const boost::filesystem::path &dump_dir,
+              const BatchConfig &config, const BatchValidator &validate);
+
+// Combines the result files of several shards into one summary. Duplicate
+// results are reported, as are programs of the corpus without a result.
+// Programs of the corpus that share the content of a validated program get
+// its result.
+int merge_results(const std::vector<boost::filesystem::path> &results_files,
+                  const std::vector<boost::filesystem::path> &corpus_files,
+                  const boost::filesystem::path &dump_dir,
+                  const BatchConfig &config);
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_VALIDATE_BATCH_H_
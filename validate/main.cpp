@@ -1,10 +1,35 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <thread>
 
 #include "boost/filesystem.hpp"
 
+#include "backends/p4test/midend.h"
+#include "frontends/common/parseInput.h"
+#include "frontends/p4/frontend.h"
+
+#include "../common/state.h"
 #include "../common/util.h"
 #include "../compare/compare.h"
+#include "batch.h"
 #include "options.h"
+#include "pipeline.h"
 
 namespace fs = boost::filesystem;
 
@@ -13,70 +38,375 @@ static const auto COMPILER_BIN = FILE_DIR / "../../p4c/build/p4test";
 static const auto DUMP_DIR = fs::path("validated");
 
 static constexpr auto PASSES = "--top4 FrontEnd,MidEnd,PassManager ";
+// The compiler prints this before it writes a dump.
+static constexpr auto DUMP_MSG = "Writing program to ";
 
 static constexpr auto SEC_TO_MS = 1000000.0;
 
-std::vector<cstring> generate_pass_list(const fs::path &p4_file,
-                                        const fs::path &dump_dir,
-                                        const fs::path &compiler_bin) {
+// A dumped pass and the hash of its content.
+struct PassDump {
+    cstring path;
+    uint64_t hash;
+};
+
+// Thrown by the debug hook to abort the compiler passes.
+struct StopCompilation {};
+
+cstring get_compiler_cmd(const fs::path &p4_file, const fs::path &dump_dir,
+                         const fs::path &compiler_bin) {
+    // A single verbose compiler run dumps the passes and lists their order.
     cstring cmd = compiler_bin.c_str();
-    cmd += " " + cstring(PASSES) + " ";
+    cmd += " --Wdisable -v " + cstring(PASSES) + " ";
     cmd += cstring("--dump ") + dump_dir.c_str() + " " + p4_file.c_str();
     cmd += " 2>&1";
+    return cmd;
+}
+
+std::vector<PassDump> generate_pass_list(const fs::path &p4_file,
+                                         const fs::path &dump_dir,
+                                         const fs::path &compiler_bin) {
+    auto cmd = get_compiler_cmd(p4_file, dump_dir, compiler_bin);
     std::stringstream output;
     TOZ3::exec(cmd, output);
-    std::vector<cstring> pass_list;
-    cstring cmd1 = compiler_bin.c_str();
-    cmd1 += cstring(" --Wdisable  -v ") + p4_file.c_str();
-    cmd1 += " 2>&1 ";
-    cmd1 += "| sed -e '/FrontEnd\\|MidEnd\\|PassManager/!d' | ";
-    cmd1 += "sed -e '/Writing program to/d' ";
-    std::stringstream passes;
-    TOZ3::exec(cmd1, passes);
-    std::string pass;
-    while (std::getline(passes, pass, '\n')) {
-        cstring pass_path =
-            (dump_dir /
-             (cstring(p4_file.stem().c_str()) + "-" + pass + ".p4").c_str())
-                .c_str();
-        pass_list.emplace_back(pass_path.c_str());
-    }
-
-    if (pass_list.size() < 2) {
-        return pass_list;
-    }
-
-    std::vector<cstring> pruned_pass_list;
-    auto it = pass_list.begin();
-    auto pass_before = *it;
-    pruned_pass_list.emplace_back(pass_before);
-    std::advance(it, 1);
-    for (; it != pass_list.end(); ++it) {
-        auto pass_after = *it;
-        if (TOZ3::compare_files(pass_before, pass_after)) {
-            fs::detail::remove(pass_after.c_str());
+
+    // Collect the dumps of this program in the dump directory.
+    cstring prefix = cstring(p4_file.stem().c_str()) + "-";
+    std::map<cstring, fs::path> dumps;
+    for (const auto &entry : fs::directory_iterator(dump_dir)) {
+        cstring file_name = entry.path().filename().c_str();
+        if (file_name.startsWith(prefix) && file_name.endsWith(".p4")) {
+            auto pass = file_name.substr(prefix.size(),
+                                         file_name.size() - prefix.size() - 3);
+            dumps.emplace(pass, entry.path());
+        }
+    }
+
+    // Order the dumps by the pass log and drop any content we have seen.
+    // Passes that return to an earlier program collapse this way too.
+    std::vector<PassDump> pass_list;
+    std::set<uint64_t> seen_hashes;
+    std::string line;
+    while (std::getline(output, line, '\n')) {
+        if (line.find(DUMP_MSG) != std::string::npos) {
+            continue;
+        }
+        auto dump = dumps.find(line);
+        if (dump == dumps.end()) {
+            continue;
+        }
+        std::ifstream dump_file(dump->second.c_str());
+        std::stringstream content;
+        content << dump_file.rdbuf();
+        auto hash = TOZ3::hash_content(content.str());
+        if (seen_hashes.insert(hash).second) {
+            pass_list.push_back({dump->second.c_str(), hash});
+            auto hash_str = TOZ3::hash_to_string(hash);
+            TOZ3::Logger::log_msg(1, "Pass %s has hash %s", line, hash_str);
         } else {
-            pruned_pass_list.emplace_back(pass_after);
-            pass_before = pass_after;
+            fs::remove(dump->second);
         }
+        // Every pass only appears once.
+        dumps.erase(dump);
     }
+    return pass_list;
+}
 
-    return pruned_pass_list;
+int validate_in_process(const fs::path &p4_file, ValidateOptions *options,
+                        const TOZ3::CompareConfig &config, size_t *num_passes) {
+    options->file = p4_file.c_str();
+    const auto *program = P4::parseP4File(*options);
+    if (program == nullptr || ::errorCount() > 0) {
+        std::cerr << "Unable to parse program." << std::endl;
+        return EXIT_FAILURE;
+    }
+    z3::context ctx;
+    TOZ3::P4State state(&ctx);
+    std::vector<TOZ3::Z3Prog> z3_progs;
+    // In a pipeline every program gets its own context and is checked on the
+    // solver thread while the passes continue. The solver thread only logs
+    // into a buffer of the pipeline and otherwise never uses P4C, so the
+    // passes run outside of a P4CSection.
+    std::unique_ptr<TOZ3::PassPipeline> pipeline;
+    if (options->pipeline) {
+        pipeline =
+            std::make_unique<TOZ3::PassPipeline>(config, options->stop_early);
+    }
+    auto add_program = [&](cstring prog_name,
+                           const IR::P4Program *prog) -> bool {
+        if (pipeline == nullptr) {
+            return TOZ3::add_z3_prog(&state, prog_name, prog, &z3_progs);
+        }
+        auto pipeline_pass = std::make_unique<TOZ3::PipelinePass>();
+        pipeline_pass->ctx = std::make_unique<z3::context>();
+        std::vector<TOZ3::Z3Prog> pass_progs;
+        if (!TOZ3::add_z3_prog(pipeline_pass->ctx.get(), prog_name, prog,
+                               &pass_progs)) {
+            return false;
+        }
+        pipeline_pass->prog = pass_progs.back();
+        // Hand over the context without any references left in this thread.
+        pass_progs.clear();
+        if (!pipeline->push(std::move(pipeline_pass))) {
+            throw StopCompilation();
+        }
+        return true;
+    };
+    // Interpret each program right after the pass that produced it.
+    const IR::Node *prev_program = program;
+    bool interpreted = true;
+    auto hook = [&](const char *manager, unsigned seq_no, const char *pass,
+                    const IR::Node *node) {
+        const auto *pass_program = node->to<IR::P4Program>();
+        // Passes that do not change the program return the same node.
+        if (!interpreted || pass_program == nullptr || node == prev_program) {
+            return;
+        }
+        prev_program = node;
+        cstring pass_name = cstring(manager) + "_" + std::to_string(seq_no) +
+                            "_" + pass;
+        interpreted = add_program(pass_name, pass_program);
+    };
+    try {
+        interpreted = add_program(p4_file.stem().c_str(), program);
+        P4::FrontEnd frontend;
+        frontend.addDebugHook(hook);
+        program = frontend.run(*options, program);
+        if (program != nullptr && ::errorCount() == 0) {
+            P4Test::MidEnd midend(*options);
+            midend.addDebugHook(hook);
+            midend.process(program);
+        }
+    } catch (const StopCompilation &) {
+        TOZ3::Logger::log_msg(1, "Stopping the compiler early.");
+    } catch (const Util::P4CExceptionBase &bug) {
+        std::cerr << bug.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!interpreted) {
+        return EXIT_FAILURE;
+    }
+    if (::errorCount() > 0) {
+        std::cerr << "Failed to compile program." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (pipeline != nullptr) {
+        auto result = pipeline->finish();
+        *num_passes = pipeline->get_num_passes();
+        return result;
+    }
+    *num_passes = z3_progs.size();
+    if (z3_progs.size() < 2) {
+        std::cerr << "P4 file did not generate enough passes." << std::endl;
+        return EXIT_SKIPPED;
+    }
+    return TOZ3::compare_progs(&ctx, z3_progs, config);
+}
+
+// Runs the compiler in a process group of its own, so it can be stopped
+// together with everything it spawned. Returns the pid of the group, or -1.
+// output_fd is the read end of the compiler output.
+static pid_t spawn_compiler(cstring cmd, int *output_fd) {
+    std::array<int, 2> output_pipe{};
+    if (pipe2(output_pipe.data(), O_CLOEXEC) != 0) {
+        return -1;
+    }
+    // Do not duplicate buffered output in the child.
+    std::cout.flush();
+    std::cerr.flush();
+    auto pid = fork();
+    if (pid < 0) {
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Only async-signal-safe calls between fork and exec.
+        setpgid(0, 0);
+        dup2(output_pipe[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
+        _exit(EXIT_FAILURE);
+    }
+    setpgid(pid, pid);
+    close(output_pipe[1]);
+    *output_fd = output_pipe[0];
+    return pid;
+}
+
+// Interprets each dump as soon as the compiler has written it, while the
+// pipeline checks the pass pairs on its solver thread.
+int validate_pipelined(const fs::path &p4_file, const fs::path &dump_dir,
+                       const fs::path &compiler_bin, ValidateOptions *options,
+                       const TOZ3::CompareConfig &config, size_t *num_passes) {
+    // A dump is complete once the compiler closes it. Without inotify the
+    // dumps are only complete when the compiler exits.
+    int watch_fd = inotify_init1(IN_CLOEXEC);
+    if (watch_fd >= 0 &&
+        inotify_add_watch(watch_fd, dump_dir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+    auto cmd = get_compiler_cmd(p4_file, dump_dir, compiler_bin);
+    TOZ3::Logger::log_msg(1, "Executing command %s", cmd);
+    int compiler_fd = -1;
+    auto compiler_pid = spawn_compiler(cmd, &compiler_fd);
+    if (compiler_pid < 0) {
+        std::cerr << "Unable to run the compiler." << std::endl;
+        if (watch_fd >= 0) {
+            close(watch_fd);
+        }
+        return EXIT_FAILURE;
+    }
+    TOZ3::PassPipeline pipeline(config, options->stop_early);
+    std::set<uint64_t> seen_hashes;
+    // The dumps are hashed already, do not preprocess them for the cache key.
+    std::map<cstring, uint64_t> source_hashes;
+    auto pass_config = config;
+    pass_config.source_hashes = &source_hashes;
+    bool failed = false;
+    auto add_dump = [&](const std::string &dump_path) -> bool {
+        std::ifstream dump_file(dump_path);
+        std::stringstream content;
+        content << dump_file.rdbuf();
+        auto hash = TOZ3::hash_content(content.str());
+        if (!seen_hashes.insert(hash).second) {
+            fs::remove(dump_path);
+            return true;
+        }
+        source_hashes.emplace(dump_path, hash);
+        auto pipeline_pass = std::make_unique<TOZ3::PipelinePass>();
+        pipeline_pass->ctx = std::make_unique<z3::context>();
+        {
+            // The state must not outlive the handover of the context.
+            TOZ3::P4State pass_state(pipeline_pass->ctx.get());
+            if (!TOZ3::load_program(dump_path, options, pass_config,
+                                    &pass_state, nullptr,
+                                    &pipeline_pass->prog)) {
+                failed = true;
+                return false;
+            }
+        }
+        return pipeline.push(std::move(pipeline_pass));
+    };
+    // The compiler announces a dump before it writes it. Dumps are added in
+    // the order of the announcements, as soon as they are closed.
+    std::deque<std::string> pending_dumps;
+    std::set<std::string> closed_dumps;
+    bool keep_going = true;
+    auto add_closed_dumps = [&]() {
+        while (keep_going && !pending_dumps.empty()) {
+            auto name = fs::path(pending_dumps.front()).filename().string();
+            if (closed_dumps.erase(name) == 0) {
+                break;
+            }
+            keep_going = add_dump(pending_dumps.front());
+            pending_dumps.pop_front();
+        }
+    };
+    std::string output;
+    std::array<char, BUFSIZ> buffer{};
+    alignas(inotify_event) std::array<char, BUFSIZ> events{};
+    std::array<pollfd, 2> poll_fds{{{compiler_fd, POLLIN, 0},
+                                    {watch_fd, POLLIN, 0}}};
+    while (keep_going) {
+        if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            auto len = read(watch_fd, events.data(), events.size());
+            for (ssize_t pos = 0; pos < len;) {
+                const auto *event =
+                    reinterpret_cast<const inotify_event *>(&events[pos]);
+                if (event->len > 0) {
+                    closed_dumps.insert(event->name);
+                }
+                pos += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (poll_fds[0].revents & (POLLIN | POLLHUP)) {
+            auto len = read(compiler_fd, buffer.data(), buffer.size());
+            if (len <= 0) {
+                break;
+            }
+            output.append(buffer.data(), len);
+            size_t line_end = 0;
+            while ((line_end = output.find('\n')) != std::string::npos) {
+                auto line = output.substr(0, line_end);
+                output.erase(0, line_end + 1);
+                auto msg_pos = line.find(DUMP_MSG);
+                if (msg_pos != std::string::npos) {
+                    auto dump_path = line.substr(msg_pos + strlen(DUMP_MSG));
+                    dump_path.erase(dump_path.find_last_not_of("\r") + 1);
+                    pending_dumps.push_back(dump_path);
+                }
+            }
+        }
+        add_closed_dumps();
+    }
+    // After an early stop nobody reads the output anymore, stop the whole
+    // compiler group instead of waiting for it to finish.
+    if (!keep_going) {
+        kill(-compiler_pid, SIGKILL);
+    }
+    close(compiler_fd);
+    int status = 0;
+    waitpid(compiler_pid, &status, 0);
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+    // Once the compiler has exited, every announced dump is complete.
+    while (keep_going && !pending_dumps.empty()) {
+        keep_going = add_dump(pending_dumps.front());
+        pending_dumps.pop_front();
+    }
+    auto result = pipeline.finish();
+    *num_passes = pipeline.get_num_passes();
+    return failed ? EXIT_FAILURE : result;
 }
 
 int validate_translation(const fs::path &p4_file, const fs::path &dump_dir,
                          const fs::path &compiler_bin,
-                         ValidateOptions *options) {
+                         ValidateOptions *options, size_t *num_passes) {
     TOZ3::Logger::log_msg(0, "Analyzing %s", p4_file);
     std::chrono::steady_clock::time_point begin =
         std::chrono::steady_clock::now();
-    auto prog_list = generate_pass_list(p4_file, dump_dir, compiler_bin);
-    if (prog_list.size() < 2) {
-        std::cerr << "P4 file did not generate enough passes." << std::endl;
-        return EXIT_SKIPPED;
+    TOZ3::CompareConfig config;
+    config.allow_undefined = options->undefined_is_ok;
+    config.solver_threads = options->solver_threads;
+    config.solver_timeout = options->solver_timeout;
+    config.portfolio = options->solver_portfolio;
+    config.timeout_rounds = options->solver_rounds;
+    config.cache_dir = options->cache_dir;
+    config.cache_size = options->cache_size_mb * 1024 * 1024;
+    config.interpret_jobs = options->interpret_jobs;
+    config.stream = options->stream;
+    int result = EXIT_SUCCESS;
+    if (options->in_process) {
+        result = validate_in_process(p4_file, options, config, num_passes);
+    } else if (options->pipeline) {
+        result = validate_pipelined(p4_file, dump_dir, compiler_bin, options,
+                                    config, num_passes);
+    } else {
+        auto pass_list = generate_pass_list(p4_file, dump_dir, compiler_bin);
+        std::vector<cstring> prog_list;
+        // The dumps are hashed already, do not preprocess them for the
+        // cache key.
+        std::map<cstring, uint64_t> source_hashes;
+        for (const auto &pass : pass_list) {
+            prog_list.push_back(pass.path);
+            source_hashes.emplace(pass.path, pass.hash);
+        }
+        config.source_hashes = &source_hashes;
+        *num_passes = prog_list.size();
+        if (prog_list.size() < 2) {
+            std::cerr << "P4 file did not generate enough passes." << std::endl;
+            return EXIT_SKIPPED;
+        }
+        result = TOZ3::process_programs(prog_list, options, config);
     }
-    int result =
-        TOZ3::process_programs(prog_list, options, options->undefined_is_ok);
     std::chrono::steady_clock::time_point end =
         std::chrono::steady_clock::now();
     auto time_elapsed =
@@ -94,7 +424,9 @@ int main(int argc, char *const argv[]) {
     options.langVersion = CompilerOptions::FrontendVersion::P4_16;
     options.compilerVersion = "p4toz3 test";
 
-    if (options.process(argc, argv) != nullptr) {
+    auto *remaining_options = options.process(argc, argv);
+    // Merging takes any number of result files as input.
+    if (remaining_options != nullptr && !options.merge) {
         options.setInputFile();
     }
     if (::errorCount() > 0) {
@@ -104,14 +436,61 @@ int main(int argc, char *const argv[]) {
     // Initialize our logger
     TOZ3::Logger::init();
 
-    auto p4_file = fs::path(options.file);
     auto dump_dir =
         options.dump_dir != nullptr ? fs::path(options.dump_dir) : DUMP_DIR;
-    dump_dir = dump_dir / p4_file.filename().stem();
-    fs::create_directories(dump_dir);
+    if (options.merge && remaining_options != nullptr) {
+        std::vector<fs::path> results_files;
+        for (const auto *results_file : *remaining_options) {
+            results_files.emplace_back(results_file);
+        }
+        std::vector<fs::path> corpus_files;
+        if (options.merge_corpus != nullptr) {
+            corpus_files =
+                TOZ3::collect_batch_files(options.merge_corpus.c_str());
+        }
+        fs::create_directories(dump_dir);
+        TOZ3::BatchConfig batch_config;
+        batch_config.report = options.batch_report;
+        return TOZ3::merge_results(results_files, corpus_files, dump_dir,
+                                   batch_config);
+    }
+
+    auto p4_file = fs::path(options.file);
     auto compiler_bin = options.compiler_bin != nullptr
                             ? fs::path(options.compiler_bin)
                             : COMPILER_BIN;
 
-    return validate_translation(p4_file, dump_dir, compiler_bin, &options);
+    if (options.batch) {
+        auto p4_files = TOZ3::collect_batch_files(p4_file);
+        if (::errorCount() > 0) {
+            return EXIT_FAILURE;
+        }
+        fs::create_directories(dump_dir);
+        TOZ3::BatchConfig batch_config;
+        batch_config.jobs = options.batch_jobs != 0
+                                ? options.batch_jobs
+                                : std::thread::hardware_concurrency();
+        batch_config.timeout = options.batch_timeout;
+        batch_config.report = options.batch_report;
+        batch_config.results = options.batch_results;
+        batch_config.shard_index = options.shard_index;
+        batch_config.shard_count = options.shard_count;
+        if (options.shard_index >= options.shard_count) {
+            ::error("Shard index %s is out of range.", options.shard_index);
+            return EXIT_FAILURE;
+        }
+        // Every worker is forked from this process and validates one program.
+        auto validate = [&](const fs::path &prog, const fs::path &prog_dump_dir,
+                            size_t *num_passes) {
+            return validate_translation(prog, prog_dump_dir, compiler_bin,
+                                        &options, num_passes);
+        };
+        return TOZ3::run_batch(p4_files, dump_dir, batch_config, validate);
+    }
+
+    dump_dir = dump_dir / p4_file.filename().stem();
+    fs::create_directories(dump_dir);
+    size_t num_passes = 0;
+    return validate_translation(p4_file, dump_dir, compiler_bin, &options,
+                                &num_passes);
 }
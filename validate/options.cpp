@@ -1,5 +1,7 @@
 #include "options.h"
 
+#include <cstdlib>
+
 ValidateOptions::ValidateOptions() {
     registerOption(
         "--dump-dir", "folder",
@@ -22,4 +24,205 @@ ValidateOptions::ValidateOptions() {
             return true;
         },
         "Toggle to tolerate undefined behavior in comparison.");
+    registerOption(
+        "--solver-threads", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_threads = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid number of solver threads: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Check the output fields of each pass pair in parallel with the "
+        "given number of threads.");
+    registerOption(
+        "--solver-timeout", "ms",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_timeout = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid solver timeout: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Timeout of a single solver query in milliseconds. Queries that "
+        "time out are retried with an escalating timeout.");
+    registerOption(
+        "--solver-portfolio", "configs",
+        [this](const char *arg) {
+            return TOZ3::parse_solver_portfolio(arg, &solver_portfolio);
+        },
+        "Race these comma-separated solver configurations on every query "
+        "and use the first answer. Known configurations are default, "
+        "qfbv-tactic and qfbv.");
+    registerOption(
+        "--solver-rounds", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            solver_rounds = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0' || solver_rounds == 0) {
+                ::error("Invalid number of solver rounds: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "How often a query is tried when it times out. The timeout doubles "
+        "with every round.");
+    registerOption(
+        "--cache-dir", "folder",
+        [this](const char *arg) {
+            cache_dir = arg;
+            return true;
+        },
+        "Cache the Z3 representation of each program in this folder and "
+        "reuse it for programs with identical content. Solver results are "
+        "cached as well.");
+    registerOption(
+        "--cache-size", "megabytes",
+        [this](const char *arg) {
+            char *end = nullptr;
+            cache_size_mb = std::strtoull(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid cache size: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Size limit of the cache folder. The least recently used entries are "
+        "evicted first. Defaults to 1024 megabytes.");
+    registerOption(
+        "--interpret-jobs", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            interpret_jobs = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid number of interpreter jobs: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Interpret the programs in this many worker processes.");
+    registerOption(
+        "--stream", nullptr,
+        [this](const char *) {
+            stream = true;
+            return true;
+        },
+        "Compare each program right after interpreting it and keep only two "
+        "programs in memory.");
+    registerOption(
+        "--pipeline", nullptr,
+        [this](const char *) {
+            pipeline = true;
+            return true;
+        },
+        "Interpret and compare the passes while the compiler is still "
+        "producing them.");
+    registerOption(
+        "--stop-early", nullptr,
+        [this](const char *) {
+            stop_early = true;
+            return true;
+        },
+        "With --pipeline, stop the compiler at the first failing pass pair.");
+    registerOption(
+        "--in-process", nullptr,
+        [this](const char *) {
+            in_process = true;
+            return true;
+        },
+        "Run the front and mid end passes in this process and interpret "
+        "each intermediate program directly, without dumping files.");
+    registerOption(
+        "--batch", nullptr,
+        [this](const char *) {
+            batch = true;
+            return true;
+        },
+        "Validate a corpus. The input is a folder of P4 programs or a file "
+        "listing one program per line.");
+    registerOption(
+        "--batch-jobs", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            batch_jobs = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid number of batch jobs: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Number of programs validated concurrently in batch mode. Defaults "
+        "to the number of cores.");
+    registerOption(
+        "--batch-timeout", "seconds",
+        [this](const char *arg) {
+            char *end = nullptr;
+            batch_timeout = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid batch timeout: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Wall-clock budget of a single program in batch mode.");
+    registerOption(
+        "--batch-report", "file",
+        [this](const char *arg) {
+            batch_report = arg;
+            return true;
+        },
+        "Where the summary of a batch run is written. Files ending in .csv "
+        "are written as CSV, all others as JSON.");
+    registerOption(
+        "--batch-results", "file",
+        [this](const char *arg) {
+            batch_results = arg;
+            return true;
+        },
+        "Append-only file which records every finished program of a batch "
+        "run. Programs listed in it are skipped when the run is resumed.");
+    registerOption(
+        "--shard-index", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            shard_index = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0') {
+                ::error("Invalid shard index: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Only validate the programs of this shard in batch mode.");
+    registerOption(
+        "--shard-count", "num",
+        [this](const char *arg) {
+            char *end = nullptr;
+            shard_count = std::strtoul(arg, &end, 10);
+            if (end == arg || *end != '\0' || shard_count == 0) {
+                ::error("Invalid shard count: %s", arg);
+                return false;
+            }
+            return true;
+        },
+        "Split the corpus into this many shards by the content hash of the "
+        "programs.");
+    registerOption(
+        "--merge", nullptr,
+        [this](const char *) {
+            merge = true;
+            return true;
+        },
+        "Combine the shard result files given as input into one report.");
+    registerOption(
+        "--merge-corpus", "folder",
+        [this](const char *arg) {
+            merge_corpus = arg;
+            return true;
+        },
+        "When merging, report the programs of this corpus without a result. "
+        "Accepts a folder or a list file.");
 }
@@ -6,7 +6,9 @@
 
 #include "frontends/common/options.h"
 
-class ValidateOptions : public ParserOptions {
+#include "../compare/compare.h"
+
+class ValidateOptions : public CompilerOptions {
  private:
     static constexpr const char *defaultMessage = "Validate a P4 program";
 
@@ -18,6 +20,45 @@ class ValidateOptions : public ParserOptions {
     cstring dump_dir;
     // Toggle this to allow differences in undefined behavior.
     bool undefined_is_ok = false;
+    // Number of threads used to check the output fields of a pass pair.
+    size_t solver_threads = 0;
+    // Timeout of a single solver query in milliseconds.
+    unsigned solver_timeout = 0;
+    // Solver configurations that race against each other.
+    std::vector<TOZ3::SolverConfig> solver_portfolio;
+    // How often a query is tried when it times out.
+    size_t solver_rounds = 3;
+    // Where the Z3 representations of interpreted programs are cached.
+    cstring cache_dir = nullptr;
+    // Size limit of the cache folder in megabytes.
+    uint64_t cache_size_mb = 1024;
+    // Number of worker processes which interpret the programs.
+    size_t interpret_jobs = 0;
+    // Compare each program right after interpreting it.
+    bool stream = false;
+    // Check pass pairs while the compiler still produces passes.
+    bool pipeline = false;
+    // Stop the compiler once the pipeline found a failing pass pair.
+    bool stop_early = false;
+    // Run the compiler passes in this process instead of using p4test.
+    bool in_process = false;
+    // Treat the input as a corpus folder or a list file of programs.
+    bool batch = false;
+    // Number of programs validated concurrently in batch mode.
+    size_t batch_jobs = 0;
+    // Wall-clock budget of a single program in seconds.
+    unsigned batch_timeout = 0;
+    // Where the summary of a batch run is written.
+    cstring batch_report = nullptr;
+    // Append-only result file of this shard.
+    cstring batch_results = nullptr;
+    // Which part of the corpus this process validates.
+    size_t shard_index = 0;
+    size_t shard_count = 1;
+    // Combine the result files given as input into one report.
+    bool merge = false;
+    // The corpus used to find programs without a result when merging.
+    cstring merge_corpus = nullptr;
 };
 
 using P4toZ3Context = P4CContextWithOptions<ValidateOptions>;
@@ -0,0 +1,106 @@
+#include "pipeline.h"
+
+#include <iostream>
+#include <utility>
+
+#include "../common/util.h"
+#include "../compare/cache.h"
+
+namespace TOZ3 {
+
+PassPipeline::PassPipeline(const CompareConfig &config, bool stop_early)
+    : config(config), stop_early(stop_early) {
+    solver = std::thread(&PassPipeline::run_solver, this);
+}
+
+PassPipeline::~PassPipeline() {
+    if (solver.joinable()) {
+        join_solver();
+        log_buffer.flush();
+    }
+}
+
+bool PassPipeline::push(std::unique_ptr<PipelinePass> pass) {
+    log_buffer.flush();
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cv.wait(lock,
+                  [this] { return stopped || queue.size() < PIPELINE_DEPTH; });
+    if (stopped) {
+        return false;
+    }
+    num_passes++;
+    if (solver_done) {
+        return true;
+    }
+    queue.push_back(std::move(pass));
+    queue_cv.notify_all();
+    return true;
+}
+
+std::unique_ptr<PipelinePass> PassPipeline::pop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cv.wait(lock, [this] { return closed || !queue.empty(); });
+    if (queue.empty()) {
+        return nullptr;
+    }
+    auto pass = std::move(queue.front());
+    queue.pop_front();
+    queue_cv.notify_all();
+    return pass;
+}
+
+void PassPipeline::run_solver() {
+    Logger::set_thread_buffer(&log_buffer);
+    std::unique_ptr<PipelinePass> prev;
+    while (auto next = pop()) {
+        if (prev == nullptr) {
+            prev = std::move(next);
+            continue;
+        }
+        // Check the pair in the context of the newer pass and release the
+        // older one, so only two passes are alive at a time.
+        auto prog_before = translate_prog(prev->prog, next->ctx.get());
+        prev.reset();
+        auto pair_result = compare_programs(
+            next->ctx.get(), {prog_before, next->prog}, config);
+        result.structural_fields += pair_result.structural_fields;
+        result.solver_fields += pair_result.solver_fields;
+        if (pair_result.exit_code != EXIT_SUCCESS) {
+            result.exit_code = pair_result.exit_code;
+            result.error = pair_result.error;
+            result.counterexample = pair_result.counterexample;
+            result.prog_before = pair_result.prog_before;
+            result.prog_after = pair_result.prog_after;
+            break;
+        }
+        prev = std::move(next);
+    }
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    // Without a solver the producer must not block on a full queue.
+    solver_done = true;
+    stopped = result.exit_code != EXIT_SUCCESS && stop_early;
+    queue.clear();
+    queue_cv.notify_all();
+}
+
+void PassPipeline::join_solver() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        closed = true;
+        queue_cv.notify_all();
+    }
+    solver.join();
+}
+
+int PassPipeline::finish() {
+    CacheEvictor evictor(config.cache_dir, config.cache_size);
+    join_solver();
+    log_buffer.flush();
+    if (num_passes < 2) {
+        std::cerr << "P4 file did not generate enough passes." << std::endl;
+        return EXIT_SKIPPED;
+    }
+    return report_result(result);
+}
+
+}  // namespace TOZ3
@@ -0,0 +1,67 @@
+#ifndef TOZ3_VALIDATE_PIPELINE_H_
+#define TOZ3_VALIDATE_PIPELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "../common/util.h"
+#include "../compare/compare.h"
+
+namespace TOZ3 {
+// Number of interpreted passes that may wait for the solver.
+constexpr size_t PIPELINE_DEPTH = 4;
+
+// An interpreted pass and the context which owns its expressions.
+struct PipelinePass {
+    std::unique_ptr<z3::context> ctx;
+    // Declared after ctx, so it is destroyed first.
+    Z3Prog prog;
+};
+
+// Checks pass pairs on a solver thread while the passes are still being
+// produced. The producer hands over a pass with its context and must not
+// touch either afterwards.
+class PassPipeline {
+ private:
+    CompareConfig config;
+    bool stop_early;
+    std::deque<std::unique_ptr<PipelinePass>> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    // No more passes will be pushed.
+    bool closed = false;
+    // The solver has returned, later passes are dropped.
+    bool solver_done = false;
+    // The solver found a failing pair and the producer should stop.
+    bool stopped = false;
+    size_t num_passes = 0;
+    CompareResult result;
+    // The solver thread must not use the P4C log while the producer runs
+    // passes, its messages are logged by the producer instead.
+    LogBuffer log_buffer;
+    std::thread solver;
+
+    std::unique_ptr<PipelinePass> pop();
+    void run_solver();
+    void join_solver();
+
+ public:
+    PassPipeline(const CompareConfig &config, bool stop_early);
+    ~PassPipeline();
+    PassPipeline(const PassPipeline &) = delete;
+    PassPipeline &operator=(const PassPipeline &) = delete;
+
+    // Blocks while the queue is full. Returns false once the pipeline found
+    // a failing pair and stops early, the producer should stop then.
+    bool push(std::unique_ptr<PipelinePass> pass);
+    // Waits for the solver, prints the result and returns the exit code.
+    int finish();
+    size_t get_num_passes() const { return num_passes; }
+};
+
+}  // namespace TOZ3
+
+#endif  // TOZ3_VALIDATE_PIPELINE_H_
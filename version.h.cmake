@@ -35,4 +35,11 @@ limitations under the License.
 
 #define P4C_TOZ3_VERSION_STRING "@P4C_VERSION@"
 
-#endif _TOZ3_VERSION_H_
+/**
+  Version of the Z3 representation of programs, the hash of the library
+  sources. Cached representations and solver results of other versions are
+  ignored.
+  */
+#define TOZ3_REPR_VERSION "toz3-repr-@TOZ3_REPR_VERSION@"
+
+#endif  // _TOZ3_VERSION_H_